@@ -16,141 +16,31 @@
 
 
 
-/**************************************************************************
-Implemetation of Kabsch algoritm for finding the best rotation matrix
----------------------------------------------------------------------------
-x    - x(i,m) are coordinates of atom m in set x            (input)
-y    - y(i,m) are coordinates of atom m in set y            (input)
-n    - n is number of atom pairs                            (input)
-mode  - 0:calculate rms only                                (input)
-1:calculate u,t only                                (takes medium)
-2:calculate rms,u,t                                 (takes longer)
-rms   - sum of w*(ux+t-y)**2 over all atom pairs            (output)
-u    - u(i,j) is   rotation  matrix for best superposition  (output)
-t    - t(i)   is translation vector for best superposition  (output)
-**************************************************************************/
-bool Kabsch(double **x,
-	double **y,
-	int n,
-	int mode,
-	double *rms,
-	double t[3],
-	double u[3][3]
-	)
+//the superposition of the eigen-solver of Kabsch, from the centered
+//cross-covariance r (r[a][b] is the sum of y_a*x_b), the centers xc and yc
+//and e0 as for QCP_superpose. QCP_superpose leaves to it the sets whose
+//rotation is not defined by a single eigenvector: fewer than 3 pairs, and
+//collinear sets. Its two Gram-Schmidt branches then complete the rotation
+//from the available directions, or leave u the identity if they fail too.
+//u and t are the identity on entry.
+void Kabsch_eigen(const double r[3][3], const double xc[3],
+	const double yc[3], double e0, int mode, double *rms, double t[3],
+	double u[3][3])
 {
 	int i, j, m, m1, l, k;
-	double e0, rms1, d, h, g;
+	double rms1 = 0, d, h, g;
 	double cth, sth, sqrth, p, det, sigma;
-	double xc[3], yc[3];
-	double a[3][3], b[3][3], r[3][3], e[3], rr[6], ss[6];
+	double a[3][3], b[3][3], e[3], rr[6], ss[6];
 	double sqrt3 = 1.73205080756888, tol = 0.01;
 	int ip[] = { 0, 1, 3, 1, 2, 4, 3, 4, 5 };
 	int ip2312[] = { 1, 2, 0, 1 };
 
-	int a_failed = 0, b_failed = 0;
+	int a_failed = 0, b_failed = 0, u_set = 0;
 	double epsilon = 0.00000001;
 
-	//initializtation
-	*rms = 0;
-	rms1 = 0;
-	e0 = 0;
-	double c1[3], c2[3];
-	double s1[3], s2[3];
-	double sx[3], sy[3], sz[3];
-	for (i = 0; i < 3; i++)
-	{
-		s1[i] = 0.0;
-		s2[i] = 0.0;
-
-		sx[i] = 0.0;
-		sy[i] = 0.0;
-		sz[i] = 0.0;
-	}
-
 	for (i = 0; i<3; i++)
-	{
-		xc[i] = 0.0;
-		yc[i] = 0.0;
-		t[i] = 0.0;
-		for (j = 0; j<3; j++)
-		{
-			u[i][j] = 0.0;
-			r[i][j] = 0.0;
-			a[i][j] = 0.0;
-			if (i == j)
-			{
-				u[i][j] = 1.0;
-				a[i][j] = 1.0;
-			}
-		}
-	}
-
-	if (n<1)
-	{
-		return false;
-	}
-
-	//compute centers for vector sets x, y
-	for (i = 0; i<n; i++)
-	{
-		for (j = 0; j < 3; j++)
-		{
-			c1[j] = x[i][j];
-			c2[j] = y[i][j];
-
-			s1[j] += c1[j];
-			s2[j] += c2[j];
-		}
-
-		for (j = 0; j < 3; j++)
-		{
-			sx[j] += c1[0] * c2[j];
-			sy[j] += c1[1] * c2[j];
-			sz[j] += c1[2] * c2[j];
-		}
-	}
-	for (i = 0; i < 3; i++)
-	{
-		xc[i] = s1[i] / n;
-		yc[i] = s2[i] / n;
-	}
-	if (mode == 2 || mode == 0)
-	{
-		for (int mm = 0; mm < n; mm++)
-		{
-			for (int nn = 0; nn < 3; nn++)
-			{
-				e0 += (x[mm][nn] - xc[nn]) * (x[mm][nn] - xc[nn]) + (y[mm][nn] - yc[nn]) * (y[mm][nn] - yc[nn]);
-			}
-		}
-	}
-	for (j = 0; j < 3; j++)
-	{
-		r[j][0] = sx[j] - s1[0] * s2[j] / n;
-		r[j][1] = sy[j] - s1[1] * s2[j] / n;
-		r[j][2] = sz[j] - s1[2] * s2[j] / n;
-	}
+		for (j = 0; j<3; j++) a[i][j] = (i == j) ? 1.0 : 0.0;
 
-	//for(i=0; i<3; i++)
-	//{
-	//    xc[i] = xc[i]/n;
-	//    yc[i] = yc[i]/n;        
-	//}
-	//
-	////compute e0 and matrix r
-	//for(m=0; m<n; m++)
-	//{
-	//    for (i=0; i<3; i++)
-	//    {
-	//        e0 += (x[m][i]-xc[i])*(x[m][i]-xc[i])+\
-	    //              (y[m][i]-yc[i])*(y[m][i]-yc[i]);
-	//        d = y[m][i] - yc[i];
-	//        for(j=0; j<3; j++)
-	//        {
-	//            r[i][j] += d*(x[m][j] - xc[j]);
-	//        }
-	//    }        
-	//}
 	//compute determinat of matrix r
 	det = r[0][0] * (r[1][1] * r[2][2] - r[1][2] * r[2][1])\
 		- r[0][1] * (r[1][0] * r[2][2] - r[1][2] * r[2][0])\
@@ -389,24 +279,16 @@ bool Kabsch(double **x,
 							+ b[i][2] * a[j][2];
 					}
 				}
-			}
-
-			//compute t
-			for (i = 0; i<3; i++)
-			{
-				t[i] = ((yc[i] - u[i][0] * xc[0]) - u[i][1] * xc[1])\
-					- u[i][2] * xc[2];
+				u_set = 1;
 			}
 		}//if(mode!=0 && a_failed!=1)
 	}//spur>0
-	else //just compute t and errors
+
+	//compute t, also for the identity u left when a or b failed
+	for (i = 0; i<3; i++)
 	{
-		//compute t
-		for (i = 0; i<3; i++)
-		{
-			t[i] = ((yc[i] - u[i][0] * xc[0]) - u[i][1] * xc[1]) - u[i][2] * xc[2];
-		}
-	}//else spur>0 
+		t[i] = ((yc[i] - u[i][0] * xc[0]) - u[i][1] * xc[1]) - u[i][2] * xc[2];
+	}
 
 	//compute rms
 	for (i = 0; i<3; i++)
@@ -421,6 +303,16 @@ bool Kabsch(double **x,
 	}
 	d = (d + e[1]) + e[0];
 
+	//the small eigenvalues of these sets carry rounding errors of the order
+	//of spur, and their square roots far larger ones; with u known, the sum
+	//of y.(u x) is taken from r instead
+	if (mode == 2 && u_set)
+	{
+		d = 0;
+		for (i = 0; i<3; i++)
+			for (j = 0; j<3; j++) d += u[i][j] * r[i][j];
+	}
+
 	if (mode == 2 || mode == 0)
 	{
 		rms1 = (e0 - d) - d;
@@ -429,8 +321,321 @@ bool Kabsch(double **x,
 	}
 
 	*rms = rms1;
+}
 
+
+//the QCP superposition of Kabsch from the sums over the n pairs of x (s1),
+//of y (s2) and of y x^T (s[a][b] is the sum of y_a*x_b). e0, the sum of
+//squares of centered x and y, is only used by modes 0 and 2. u and t are
+//the identity on entry. Sets of fewer than 3 pairs or of zero covariance,
+//and sets whose eigenvector is not defined to precision relative to the
+//key matrix, e.g. collinear ones, are left to Kabsch_eigen.
+void QCP_superpose(const double s1[3], const double s2[3],
+	const double s[3][3], int n, double e0, int mode, double *rms,
+	double t[3], double u[3][3])
+{
+	int i;
+	double xc[3], yc[3];
+	double lambda, lambda_old;
+	const double eval_prec = 1e-11, evec_prec = 1e-12;
+
+	for (i = 0; i<3; i++)
+	{
+		xc[i] = s1[i] / n;
+		yc[i] = s2[i] / n;
+	}
+
+	//centered cross-covariance as Kabsch_eigen takes it
+	double r[3][3];
+	for (i = 0; i<3; i++)
+		for (int j = 0; j<3; j++) r[i][j] = s[i][j] - s1[j] * s2[i] / n;
+
+	//centered cross-covariance
+	double sxx = s[0][0] - s2[0] * xc[0], sxy = s[0][1] - s2[0] * xc[1], sxz = s[0][2] - s2[0] * xc[2];
+	double syx = s[1][0] - s2[1] * xc[0], syy = s[1][1] - s2[1] * xc[1], syz = s[1][2] - s2[1] * xc[2];
+	double szx = s[2][0] - s2[2] * xc[0], szy = s[2][1] - s2[2] * xc[1], szz = s[2][2] - s2[2] * xc[2];
+
+	//coefficients of the characteristic polynomial
+	//lambda^4 + c2*lambda^2 + c1*lambda + c0 of the key matrix
+	double sxx2 = sxx*sxx, syy2 = syy*syy, szz2 = szz*szz;
+	double sxy2 = sxy*sxy, syz2 = syz*syz, sxz2 = sxz*sxz;
+	double syx2 = syx*syx, szy2 = szy*szy, szx2 = szx*szx;
+	double c2 = -2.0*(sxx2 + syy2 + szz2 + sxy2 + syx2 + sxz2 + szx2 + syz2 + szy2);
+	if (n < 3 || c2 == 0)
+	{
+		Kabsch_eigen(r, xc, yc, e0, mode, rms, t, u);
+		return;
+	}
+
+	//lambda is at most the sum of the singular values of the covariance,
+	//sqrt(3) times its Frobenius norm sqrt(-c2/2), and at most e0/2, half
+	//the sum of squares of centered x and y
+	lambda = sqrt(-1.5*c2);
+	if ((mode == 2 || mode == 0) && e0 / 2<lambda) lambda = e0 / 2;
+	double syzszymsyyszz2 = 2.0*(syz*szy - syy*szz);
+	double sxx2syy2szz2syz2szy2 = syy2 + szz2 - sxx2 + syz2 + szy2;
+	double c1 = 8.0*(sxx*syz*szy + syy*szx*sxz + szz*sxy*syx
+		- sxx*syy*szz - syz*szx*sxy - szy*syx*sxz);
+	double sxzpszx = sxz + szx, syzpszy = syz + szy, sxypsyx = sxy + syx;
+	double syzmszy = syz - szy, sxzmszx = sxz - szx, sxymsyx = sxy - syx;
+	double sxxpsyy = sxx + syy, sxxmsyy = sxx - syy;
+	double sxy2sxz2syx2szx2 = sxy2 + sxz2 - syx2 - szx2;
+	double c0 = sxy2sxz2syx2szx2*sxy2sxz2syx2szx2
+		+ (sxx2syy2szz2syz2szy2 + syzszymsyyszz2)*(sxx2syy2szz2syz2szy2 - syzszymsyyszz2)
+		+ (-sxzpszx*syzmszy + sxymsyx*(sxxmsyy - szz))*(-sxzmszx*syzpszy + sxymsyx*(sxxmsyy + szz))
+		+ (-sxzpszx*syzpszy - sxypsyx*(sxxpsyy - szz))*(-sxzmszx*syzmszy - sxypsyx*(sxxpsyy + szz))
+		+ (sxypsyx*syzpszy + sxzpszx*(sxxmsyy + szz))*(-sxymsyx*syzmszy + sxzpszx*(sxxpsyy + szz))
+		+ (sxypsyx*syzmszy + sxzmszx*(sxxmsyy - szz))*(-sxymsyx*syzpszy + sxzmszx*(sxxpsyy - szz));
+
+	//Newton iterations from the upper bound, which decrease to the largest
+	//root as the roots are real
+	for (i = 0; i<50; i++)
+	{
+		lambda_old = lambda;
+		double l2 = lambda*lambda;
+		double b = (l2 + c2)*lambda;
+		double a = b + c1;
+		double slope = 2.0*l2*lambda + b + a;
+		if (slope == 0) break; //at a multiple root
+		lambda -= (a*lambda + c0) / slope;
+		if (fabs(lambda - lambda_old) < fabs(eval_prec*lambda)) break;
+	}
+
+	if (mode == 2 || mode == 0)
+	{
+		*rms = e0 - 2 * lambda;
+		if (*rms < 0.0) *rms = 0.0;
+	}
+	if (mode == 0) return;
+
+	//eigenvector q of lambda from a column of the adjugate of key-lambda.
+	//The columns scale with the cube of the key matrix, whose squared
+	//Frobenius norm is -2*c2, so the cutoff on their squared norm is
+	//relative to its sixth power
+	const double key_norm2 = -2.0*c2;
+	const double evec_min = evec_prec*key_norm2*key_norm2*key_norm2;
+	double a11 = sxxpsyy + szz - lambda, a12 = syzmszy, a13 = -sxzmszx, a14 = sxymsyx;
+	double a21 = syzmszy, a22 = sxxmsyy - szz - lambda, a23 = sxypsyx, a24 = sxzpszx;
+	double a31 = a13, a32 = a23, a33 = syy - sxx - szz - lambda, a34 = syzpszy;
+	double a41 = a14, a42 = a24, a43 = a34, a44 = szz - sxxpsyy - lambda;
+	double a3344_4334 = a33*a44 - a43*a34, a3244_4234 = a32*a44 - a42*a34;
+	double a3243_4233 = a32*a43 - a42*a33, a3143_4133 = a31*a43 - a41*a33;
+	double a3144_4134 = a31*a44 - a41*a34, a3142_4132 = a31*a42 - a41*a32;
+	double q1 = a22*a3344_4334 - a23*a3244_4234 + a24*a3243_4233;
+	double q2 = -a21*a3344_4334 + a23*a3144_4134 - a24*a3143_4133;
+	double q3 = a21*a3244_4234 - a22*a3144_4134 + a24*a3142_4132;
+	double q4 = -a21*a3243_4233 + a22*a3143_4133 - a23*a3142_4132;
+	double qsqr = q1*q1 + q2*q2 + q3*q3 + q4*q4;
+
+	//the first column vanishes for degenerate sets, so try the others
+	if (qsqr <= evec_min)
+	{
+		q1 = a12*a3344_4334 - a13*a3244_4234 + a14*a3243_4233;
+		q2 = -a11*a3344_4334 + a13*a3144_4134 - a14*a3143_4133;
+		q3 = a11*a3244_4234 - a12*a3144_4134 + a14*a3142_4132;
+		q4 = -a11*a3243_4233 + a12*a3143_4133 - a13*a3142_4132;
+		qsqr = q1*q1 + q2*q2 + q3*q3 + q4*q4;
+	}
+	if (qsqr <= evec_min)
+	{
+		double a1324_1423 = a13*a24 - a14*a23, a1224_1422 = a12*a24 - a14*a22;
+		double a1223_1322 = a12*a23 - a13*a22, a1124_1421 = a11*a24 - a14*a21;
+		double a1123_1321 = a11*a23 - a13*a21, a1122_1221 = a11*a22 - a12*a21;
+
+		q1 = a42*a1324_1423 - a43*a1224_1422 + a44*a1223_1322;
+		q2 = -a41*a1324_1423 + a43*a1124_1421 - a44*a1123_1321;
+		q3 = a41*a1224_1422 - a42*a1124_1421 + a44*a1122_1221;
+		q4 = -a41*a1223_1322 + a42*a1123_1321 - a43*a1122_1221;
+		qsqr = q1*q1 + q2*q2 + q3*q3 + q4*q4;
+		if (qsqr <= evec_min)
+		{
+			q1 = a32*a1324_1423 - a33*a1224_1422 + a34*a1223_1322;
+			q2 = -a31*a1324_1423 + a33*a1124_1421 - a34*a1123_1321;
+			q3 = a31*a1224_1422 - a32*a1124_1421 + a34*a1122_1221;
+			q4 = -a31*a1223_1322 + a32*a1123_1321 - a33*a1122_1221;
+			qsqr = q1*q1 + q2*q2 + q3*q3 + q4*q4;
+		}
+	}
+
+	//no column defines q, as for collinear sets
+	if (qsqr <= evec_min)
+	{
+		Kabsch_eigen(r, xc, yc, e0, mode, rms, t, u);
+		return;
+	}
+
+	//rotation of the quaternion
+	double norm = 1.0 / sqrt(qsqr);
+	q1 *= norm; q2 *= norm; q3 *= norm; q4 *= norm;
+	double a2 = q1*q1, x2 = q2*q2, y2 = q3*q3, z2 = q4*q4;
+	double xy = q2*q3, az = q1*q4, zx = q4*q2;
+	double ay = q1*q3, yz = q3*q4, ax = q1*q2;
+	u[0][0] = a2 + x2 - y2 - z2;
+	u[0][1] = 2 * (xy + az);
+	u[0][2] = 2 * (zx - ay);
+	u[1][0] = 2 * (xy - az);
+	u[1][1] = a2 - x2 + y2 - z2;
+	u[1][2] = 2 * (yz + ax);
+	u[2][0] = 2 * (zx + ay);
+	u[2][1] = 2 * (yz - ax);
+	u[2][2] = a2 - x2 - y2 + z2;
+
+	//compute t
+	for (i = 0; i<3; i++)
+	{
+		t[i] = ((yc[i] - u[i][0] * xc[0]) - u[i][1] * xc[1]) - u[i][2] * xc[2];
+	}
+}
+
+
+/**************************************************************************
+Best superposition of x onto y by the quaternion characteristic polynomial
+(QCP) method of Theobald (2005) and Liu et al. (2010), in place of the
+eigen-solver of the Kabsch algorithm. The largest eigenvalue lambda of the
+4x4 key matrix built from the cross-covariance of x and y is the largest
+root of its characteristic polynomial, found by Newton iterations from an
+upper bound. rms is then e0-2*lambda, and the rotation is that of the
+quaternion of the eigenvector of lambda.
+---------------------------------------------------------------------------
+x    - x.x[m], x.y[m], x.z[m] are coordinates of atom m in set x (input)
+y    - y.x[m], y.y[m], y.z[m] are coordinates of atom m in set y (input)
+n    - n is number of atom pairs                            (input)
+mode  - 0:calculate rms only                                (takes least)
+1:calculate u,t only                                (takes medium)
+2:calculate rms,u,t                                 (takes longer)
+rms   - sum of w*(ux+t-y)**2 over all atom pairs            (output)
+u    - u(i,j) is   rotation  matrix for best superposition  (output)
+t    - t(i)   is translation vector for best superposition  (output)
+**************************************************************************/
+bool Kabsch(const coord_array &x,
+	const coord_array &y,
+	int n,
+	int mode,
+	double *rms,
+	double t[3],
+	double u[3][3]
+	)
+{
+	int i, j;
+	double xc[3], yc[3];
+	double e0 = 0;
+
+	//initializtation
+	*rms = 0;
+	for (i = 0; i<3; i++)
+	{
+		t[i] = 0.0;
+		for (j = 0; j<3; j++) u[i][j] = (i == j) ? 1.0 : 0.0;
+	}
+
+	if (n<1)
+	{
+		return false;
+	}
+
+	//sums of x, y and y x^T
+	double s1[3] = { 0, 0, 0 }, s2[3] = { 0, 0, 0 };
+	double sxx = 0, sxy = 0, sxz = 0, syx = 0, syy = 0, syz = 0,
+		szx = 0, szy = 0, szz = 0; //s_ab is the sum of y_a*x_b
+	for (i = 0; i<n; i++)
+	{
+		double x1 = x.x[i], x2 = x.y[i], x3 = x.z[i];
+		double y1 = y.x[i], y2 = y.y[i], y3 = y.z[i];
+		s1[0] += x1; s1[1] += x2; s1[2] += x3;
+		s2[0] += y1; s2[1] += y2; s2[2] += y3;
+		sxx += y1*x1; sxy += y1*x2; sxz += y1*x3;
+		syx += y2*x1; syy += y2*x2; syz += y2*x3;
+		szx += y3*x1; szy += y3*x2; szz += y3*x3;
+	}
+	double s[3][3] = { { sxx, sxy, sxz }, { syx, syy, syz }, { szx, szy, szz } };
+	if (mode == 2 || mode == 0)
+	{
+		for (i = 0; i<3; i++)
+		{
+			xc[i] = s1[i] / n;
+			yc[i] = s2[i] / n;
+		}
+
+		//second pass, as e0 from sums of squares would lose digits
+		for (i = 0; i<n; i++)
+		{
+			double dx1 = x.x[i] - xc[0], dx2 = x.y[i] - xc[1], dx3 = x.z[i] - xc[2];
+			double dy1 = y.x[i] - yc[0], dy2 = y.y[i] - yc[1], dy3 = y.z[i] - yc[2];
+			e0 += dx1*dx1 + dy1*dy1 + dx2*dx2 + dy2*dy2 + dx3*dx3 + dy3*dy3;
+		}
+	}
+	QCP_superpose(s1, s2, s, n, e0, mode, rms, t, u);
 	return true;
+}
+
+//4 doubles, the lanes of Kabsch_batch. Without AVX they are split into
+//pairs of SSE2 registers by the compiler
+typedef double Kabsch_v4 __attribute__((vector_size(32)));
 
+//sums of Kabsch over the fragment pairs x[i..i+n-1], y[j_b..j_b+n-1] of
+//lanes b=0..3, with j_b=j+j_off[b]. N is n fixed at compile time, or 0.
+//Each lane adds up its pairs in the same order as Kabsch
+template <int N> inline void Kabsch_batch_sums(const coord_array &x, int i,
+	const coord_array &y, int j, const int j_off[4], int n, double s1[3],
+	double s2[4][3], double s[4][3][3])
+{
+	int k, a, b;
+	if (N) n = N;
+	const tm_real *x1 = x.x + i, *x2 = x.y + i, *x3 = x.z + i;
+	const tm_real *y1 = y.x + j, *y2 = y.y + j, *y3 = y.z + j;
+	const int j1 = j_off[1], j2 = j_off[2], j3 = j_off[3];
+	double sx[3] = { 0, 0, 0 };
+	Kabsch_v4 sy[3] = { { 0 } }, sc[3][3] = { { { 0 } } };
+	const tm_real *yp[3] = { y1, y2, y3 };
+	for (k = 0; k<n; k++)
+	{
+		const double xk[3] = { x1[k], x2[k], x3[k] };
+		for (a = 0; a<3; a++)
+		{
+			const tm_real *ya = yp[a] + k;
+			const Kabsch_v4 yk = { ya[0], ya[j1], ya[j2], ya[j3] };
+			sx[a] += xk[a];
+			sy[a] += yk;
+			for (b = 0; b<3; b++) sc[a][b] += yk * xk[b];
+		}
+	}
+	for (a = 0; a<3; a++)
+	{
+		s1[a] = sx[a];
+		for (int l = 0; l<4; l++)
+		{
+			s2[l][a] = sy[a][l];
+			for (b = 0; b<3; b++) s[l][a][b] = sc[a][b][l];
+		}
+	}
 }
 
+//Kabsch mode 1, u and t only, for the n_lane<=4 fragment pairs x[i..i+n-1]
+//onto y[j_b..j_b+n-1], j_b=j+b*j_step, of one row of the seeds of
+//get_initial5. The fits are those of Kabsch one pair at a time, up to the
+//rounding of sums that -ffast-math reassociates. Fragments of fewer than 3
+//pairs go to Kabsch_eigen in QCP_superpose, as in Kabsch.
+//The 20 and 100 residue fragments of get_initial5 have their own loops, and
+//an AVX2 clone is picked at run time where the CPU has it.
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+void Kabsch_batch(const coord_array &x, int i, const coord_array &y, int j,
+	int j_step, int n_lane, int n, double t[4][3], double u[4][3][3])
+{
+	double s1[3], s2[4][3], s[4][3][3], rms;
+	int j_off[4]; //missing lanes repeat the last one, to stay within y
+	for (int l = 0; l<4; l++) j_off[l] = ((l<n_lane) ? l : n_lane - 1)*j_step;
+	if (n == 20) Kabsch_batch_sums<20>(x, i, y, j, j_off, n, s1, s2, s);
+	else if (n == 100) Kabsch_batch_sums<100>(x, i, y, j, j_off, n, s1, s2, s);
+	else Kabsch_batch_sums<0>(x, i, y, j, j_off, n, s1, s2, s);
+	for (int l = 0; l<n_lane; l++)
+	{
+		for (int a = 0; a<3; a++)
+		{
+			t[l][a] = 0.0;
+			for (int b = 0; b<3; b++) u[l][a][b] = (a == b) ? 1.0 : 0.0;
+		}
+		QCP_superpose(s1, s2[l], s[l], n, 0, 1, &rms, t[l], u[l]);
+	}
+}
@@ -0,0 +1,194 @@
+/*
+===============================================================================
+   Regression check of the superposition of Kabsch.h on the sets whose
+   rotation the QCP key matrix does not define: one pair, two pairs and
+   collinear pairs, next to planar and general sets. For each set, u must
+   be a rotation, mode 1 must give the u and t of mode 2, the rms of mode 2
+   must be that of its u and t, and a rigid copy must be superposed exactly.
+   Kabsch_batch must give the fits of Kabsch for each lane.
+
+   $ make check
+===============================================================================
+*/
+#include "basic_define.h"
+#include "global_var.h"
+#include "param_set.h"
+
+using namespace std;
+
+#include "basic_fun.h"
+#include "Kabsch.h"
+
+int n_fail=0;
+
+void check(const bool ok, const char *set, const char *what)
+{
+    if (ok) return;
+    printf("FAIL %s: %s\n", set, what);
+    n_fail++;
+}
+
+/* sum of squared deviations of x superposed by t, u from y */
+double superposed_ssd(const coord_array &x, const coord_array &y, int n,
+    double t[3], double u[3][3])
+{
+    double ssd=0;
+    for (int i=0;i<n;i++)
+    {
+        tm_real xt[3];
+        transform(t, u, x, i, xt);
+        ssd+=dist(xt, y, i);
+    }
+    return ssd;
+}
+
+/* fit x onto y in modes 1 and 2 and check the fit. rigid is true if y is
+ * a rotated and translated copy of x, and ssd_ref>=0 is the known optimum */
+void check_fit(const char *set, const coord_array &x, const coord_array &y,
+    int n, bool rigid, double ssd_ref)
+{
+    double t[3], u[3][3], rms, t1[3], u1[3][3], rms1;
+    Kabsch(x, y, n, 2, &rms, t, u);
+    Kabsch(x, y, n, 1, &rms1, t1, u1);
+
+    double orth=0, diff=0, det;
+    for (int a=0;a<3;a++)
+    {
+        diff=fmax(diff, fabs(t[a]-t1[a]));
+        for (int b=0;b<3;b++)
+        {
+            double d=u[a][0]*u[b][0]+u[a][1]*u[b][1]+u[a][2]*u[b][2];
+            orth=fmax(orth, fabs(d-(a==b)));
+            diff=fmax(diff, fabs(u[a][b]-u1[a][b]));
+        }
+    }
+    det=u[0][0]*(u[1][1]*u[2][2]-u[1][2]*u[2][1])
+       -u[0][1]*(u[1][0]*u[2][2]-u[1][2]*u[2][0])
+       +u[0][2]*(u[1][0]*u[2][1]-u[1][1]*u[2][0]);
+    double ssd=superposed_ssd(x, y, n, t, u);
+
+    check(orth==orth && orth<1e-9 && det>0, set, "u is not a rotation");
+    check(diff<1e-12, set, "mode 1 and mode 2 differ");
+    check(fabs(ssd-rms)<=1e-6*(1+ssd), set, "rms is not that of u and t");
+    if (rigid) check(ssd<1e-8, set, "rigid copy not superposed");
+    if (ssd_ref>=0) check(fabs(rms-ssd_ref)<=1e-8*(1+ssd_ref), set,
+        "rms is not the optimum");
+}
+
+/* y=R x+shift, plus noise of up to noise in each coordinate */
+void move_set(const coord_array &x, coord_array &y, int n, double noise)
+{
+    const double c=cos(0.9), s=sin(0.9), c2=cos(-0.4), s2=sin(-0.4);
+    for (int i=0;i<n;i++)
+    {
+        double a=c*x.x[i]-s*x.y[i], b=s*x.x[i]+c*x.y[i], z=x.z[i];
+        y.x[i]=a+7.5+noise*(rand()/(double)RAND_MAX-0.5);
+        y.y[i]=c2*b-s2*z-3.2+noise*(rand()/(double)RAND_MAX-0.5);
+        y.z[i]=s2*b+c2*z+11.0+noise*(rand()/(double)RAND_MAX-0.5);
+    }
+}
+
+int main()
+{
+    const int n_max=40;
+    coord_array x, y;
+    NewCoord(x, n_max);
+    NewCoord(y, n_max);
+    srand(7);
+    for (int i=0;i<n_max;i++)
+    {
+        x.x[i]=20.0*rand()/RAND_MAX-10;
+        x.y[i]=20.0*rand()/RAND_MAX-10;
+        x.z[i]=20.0*rand()/RAND_MAX-10;
+    }
+
+    /* one pair: a translation */
+    move_set(x, y, 1, 0);
+    check_fit("n=1", x, y, 1, true, 0);
+
+    /* two pairs: the optimum is (|x1-x0|-|y1-y0|)^2/2 */
+    move_set(x, y, 2, 0);
+    check_fit("n=2 rigid", x, y, 2, true, 0);
+    move_set(x, y, 2, 0.8);
+    double dx=sqrt(dist(x, 1, x, 0)), dy=sqrt(dist(y, 1, y, 0));
+    check_fit("n=2", x, y, 2, false, (dx-dy)*(dx-dy)/2);
+
+    /* collinear sets, as CA atoms 3.8 A apart on a line */
+    coord_array line;
+    NewCoord(line, n_max);
+    for (int i=0;i<n_max;i++)
+    {
+        line.x[i]=1+3.8*i*0.6;
+        line.y[i]=-2+3.8*i*0.8;
+        line.z[i]=5;
+    }
+    move_set(line, y, 3, 0);
+    check_fit("collinear n=3 rigid", line, y, 3, true, -1);
+    move_set(line, y, 6, 0);
+    check_fit("collinear n=6 rigid", line, y, 6, true, -1);
+    move_set(line, y, 6, 0.5);
+    check_fit("collinear n=6", line, y, 6, false, -1);
+    check_fit("collinear onto general n=6", line, x, 6, false, -1);
+    check_fit("general onto collinear n=6", x, line, 6, false, -1);
+
+    /* identical points */
+    coord_array same;
+    NewCoord(same, n_max);
+    for (int i=0;i<n_max;i++)
+    {
+        same.x[i]=1.5;
+        same.y[i]=-2;
+        same.z[i]=0.25;
+    }
+    check_fit("coincident n=4", same, x, 4, false, -1);
+
+    /* three pairs are always planar; four planar pairs; general sets */
+    move_set(x, y, 3, 0);
+    check_fit("n=3 rigid", x, y, 3, true, -1);
+    move_set(x, y, 3, 0.8);
+    check_fit("n=3", x, y, 3, false, -1);
+    for (int i=0;i<4;i++) line.z[i]=(i%2)?5:2;
+    move_set(line, y, 4, 0);
+    check_fit("planar n=4 rigid", line, y, 4, true, -1);
+    move_set(x, y, n_max, 0);
+    check_fit("n=40 rigid", x, y, n_max, true, -1);
+    move_set(x, y, n_max, 1.5);
+    check_fit("n=40", x, y, n_max, false, -1);
+
+    /* Kabsch_batch against Kabsch on fragments of 2, 3 and 20 pairs, whose
+     * lanes start 1 apart in y. The two add up the same pairs in the same
+     * order, but -ffast-math may reassociate the unrolled sums of a fixed n */
+    move_set(x, y, n_max, 1.5);
+    const int frag_len[3]={2, 3, 20};
+    for (int f=0;f<3;f++)
+    {
+        int n=frag_len[f];
+        double tb[4][3], ub[4][3][3], t[3], u[3][3], rms, diff=0;
+        Kabsch_batch(x, 0, y, 5, 1, 4, n, tb, ub);
+        for (int l=0;l<4;l++)
+        {
+            Kabsch(coord_slice(x, 0), coord_slice(y, 5+l), n, 1, &rms, t, u);
+            for (int a=0;a<3;a++)
+            {
+                diff=fmax(diff, fabs(tb[l][a]-t[a]));
+                for (int b=0;b<3;b++)
+                    diff=fmax(diff, fabs(ub[l][a][b]-u[a][b]));
+            }
+        }
+        char set[100];
+        sprintf(set, "Kabsch_batch n=%d", n);
+        check(diff<1e-9, set, "lanes differ from Kabsch");
+    }
+
+    DeleteCoord(x);
+    DeleteCoord(y);
+    DeleteCoord(line);
+    DeleteCoord(same);
+    if (n_fail)
+    {
+        printf("Kabsch_check: %d failed\n", n_fail);
+        return 1;
+    }
+    printf("Kabsch_check: all passed\n");
+    return 0;
+}
@@ -0,0 +1,183 @@
+/*
+===============================================================================
+   Regression check of the anti-diagonal DP of NW.h: for random chains, each
+   kernel of NWDP_diag that this CPU runs must give the j2i of the row sweep
+   NWDP_sweep. The chains are random walks of CA atoms, superposed with
+   noise and indels, and chains on an integer grid, whose cell scores tie.
+
+   $ make check
+===============================================================================
+*/
+#include "basic_define.h"
+#include "global_var.h"
+#include "param_set.h"
+
+using namespace std;
+
+#include "basic_fun.h"
+#include "NW.h"
+
+int n_fail=0;
+
+void check(const bool ok, const char *set, const char *what)
+{
+    if (ok) return;
+    printf("FAIL %s: %s\n", set, what);
+    n_fail++;
+}
+
+double uniform(double lo, double hi)
+{
+    return lo+(hi-lo)*rand()/RAND_MAX;
+}
+
+/* random walk of n CA atoms 3.8 A apart, or of unit steps on an integer
+ * grid if grid */
+void random_chain(coord_array &x, int n, bool grid)
+{
+    double p[3]={0, 0, 0};
+    for (int i=0;i<n;i++)
+    {
+        double d[3];
+        if (grid)
+        {
+            for (int a=0;a<3;a++) d[a]=0;
+            d[rand()%3]=(rand()%2)?1:-1;
+        }
+        else
+        {
+            double r;
+            do
+            {
+                for (int a=0;a<3;a++) d[a]=uniform(-1, 1);
+                r=sqrt(d[0]*d[0]+d[1]*d[1]+d[2]*d[2]);
+            } while (r<0.1 || r>1);
+            for (int a=0;a<3;a++) d[a]*=3.8/r;
+        }
+        for (int a=0;a<3;a++) p[a]+=d[a];
+        x.x[i]=p[0];
+        x.y[i]=p[1];
+        x.z[i]=p[2];
+    }
+}
+
+/* y of chain x, with residues deleted and inserted at rate indel and
+ * noise added to each coordinate; the length of y */
+int mutate_chain(const coord_array &x, int len1, coord_array &y, int n_max,
+    double indel, double noise)
+{
+    int len2=0;
+    for (int i=0;i<len1 && len2<n_max;i++)
+    {
+        if (uniform(0, 1)<indel) continue;
+        copy_coord(y, len2, x, i);
+        y.x[len2]+=uniform(-noise, noise);
+        y.y[len2]+=uniform(-noise, noise);
+        y.z[len2]+=uniform(-noise, noise);
+        len2++;
+        if (uniform(0, 1)<indel && len2<n_max)
+        {
+            copy_coord(y, len2, y, len2-1);
+            y.x[len2]+=uniform(1, 4);
+            len2++;
+        }
+    }
+    return len2;
+}
+
+/* rotation by angle about a random axis, and a translation */
+void random_superposition(double t[3], double u[3][3])
+{
+    double k[3], r;
+    do
+    {
+        for (int a=0;a<3;a++) k[a]=uniform(-1, 1);
+        r=sqrt(k[0]*k[0]+k[1]*k[1]+k[2]*k[2]);
+    } while (r<0.1 || r>1);
+    for (int a=0;a<3;a++) k[a]/=r;
+    double angle=uniform(-0.3, 0.3), c=cos(angle), s=sin(angle);
+    for (int a=0;a<3;a++)
+    {
+        t[a]=uniform(-1, 1);
+        for (int b=0;b<3;b++)
+            u[a][b]=(1-c)*k[a]*k[b]+(a==b?c:0);
+    }
+    u[0][1]-=s*k[2]; u[1][0]+=s*k[2];
+    u[0][2]+=s*k[1]; u[2][0]-=s*k[1];
+    u[1][2]-=s*k[0]; u[2][1]+=s*k[0];
+}
+
+int main()
+{
+    const int n_max=700, n_case=300;
+    const double gap_opens[3]={-0.6, 0, -1};
+    TMalign_opt opt;
+    opt.dp_threads=1;
+    TMalign_ctx ctx;
+    ctx.opt=&opt;
+    ctx.dp_block=0;
+    ctx.path=arena_alloc<unsigned char>(ctx.arena,
+        (size_t)n_max*NW_path_stride(n_max)+2*n_max+NW_LANES);
+    ctx.val=arena_alloc<tm_real>(ctx.arena, n_max+1);
+    ctx.diag=arena_alloc<bool>(ctx.arena, n_max+1);
+
+    coord_array x, y;
+    NewCoord(x, n_max);
+    NewCoord(y, n_max);
+    int j2i_row[n_max+1], j2i_diag[n_max+1];
+    srand(11);
+
+#ifdef NW_DIAG_SIMD
+    const int n_kernel=2;
+    const char *kernel_name[n_kernel]={"avx512f", "avx2"};
+    const NW_diag_kernel kernel[n_kernel]={NWDP_diag_sweep_avx512,
+        NWDP_diag_sweep_avx2};
+    const bool supported[n_kernel]={__builtin_cpu_supports("avx512f")!=0,
+        __builtin_cpu_supports("avx2")!=0};
+    int n_run=0;
+    for (int c=0;c<n_case;c++)
+    {
+        bool grid=(c%3==2);
+        int len1=1+rand()%(c<n_case/2?80:n_max/2);
+        random_chain(x, len1, grid);
+        int len2=mutate_chain(x, len1, y, n_max, uniform(0, 0.2),
+            grid?0:uniform(0, 3));
+        if (len2==0) continue;
+        double t[3], u[3][3], d02=grid?4:uniform(1, 30);
+        random_superposition(t, u);
+        if (grid)
+        {
+            for (int a=0;a<3;a++)
+                for (int b=0;b<3;b++) u[a][b]=(a==b);
+            t[0]=t[1]=t[2]=0;
+        }
+        double gap_open=gap_opens[(c/3)%3];
+
+        NWDP_sweep(ctx, NW_score_dist(x, y, t, u, d02), len1, len2,
+            gap_open, j2i_row);
+        for (int k=0;k<n_kernel;k++)
+        {
+            if (!supported[k]) continue;
+            NWDP_diag(ctx, x, y, len1, len2, t, u, d02, gap_open, j2i_diag,
+                kernel[k]);
+            char set[100];
+            sprintf(set, "%s %s len1=%d len2=%d gap_open=%g", kernel_name[k],
+                grid?"grid":"walk", len1, len2, gap_open);
+            check(memcmp(j2i_row, j2i_diag, sizeof(int)*len2)==0, set,
+                "j2i differs from NWDP_sweep");
+            n_run++;
+        }
+    }
+    if (n_run==0) printf("NW_check: no AVX-512 or AVX2, NWDP_diag not run\n");
+#endif
+
+    DeleteCoord(x);
+    DeleteCoord(y);
+    if (n_fail)
+    {
+        printf("NW_check: %d failed\n", n_fail);
+        return 1;
+    }
+    printf("NW_check: all passed\n");
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+===============================================================================
+   The anti-diagonal kernel of NWDP_diag, included by NW.h once for each
+   instruction set, under the #pragma GCC target of that set. NW_DIAG_KERNEL
+   is the name of the kernel and NW_DIAG_BYTES the bytes of its vectors.
+
+   The body has to be compiled for the target of each kernel: a shared
+   function of the default target would have its wide vectors split into
+   scalars before it is inlined into the kernels.
+===============================================================================
+*/
+
+//the DP of NWDP_TM by anti-diagonals, whose cells do not depend on each
+//other, NW_DIAG_BYTES of cells at a time. xt holds x superposed, and y
+//holds chain 2 backwards, so that cell (i,j) pairs xt[i-1] and
+//y[len2-s+i] and both are read forwards along a diagonal; each has
+//NW_LANES residues of padding. val holds 3 and gap 2 diagonals of
+//len1+1+NW_LANES values: for each cell its value, and gap_open if it came
+//from the diagonal, else 0, which is the single layer gap rule of
+//NWDP_row. The 2-bit moves of diagonal s are packed from
+//path+path_start[s], in the order of i.
+void NW_DIAG_KERNEL(const coord_array &xt, const coord_array &y, int len1,
+	int len2, tm_real d02, tm_real gap_open, tm_real *val[3],
+	tm_real *gap[2], unsigned char *path, int path_start[])
+{
+	typedef tm_real vec __attribute__((vector_size(NW_DIAG_BYTES)));
+	typedef tm_real uvec __attribute__((vector_size(NW_DIAG_BYTES),
+		aligned(sizeof(tm_real))));
+	typedef decltype(vec()<vec()) vmask;
+	const int lanes=NW_DIAG_BYTES/sizeof(tm_real);
+	typedef unsigned char vcode __attribute__((vector_size(lanes)));
+
+	int s, i, k, pos=0;
+	const vec d02v=vec()+d02, gap_openv=vec()+gap_open, zero=vec(),
+		one=zero+1;
+	const vmask code_diag=vmask()+NW_DIAG, code_left=vmask()+NW_LEFT,
+		code_up=vmask()+NW_UP;
+	tm_real *val2=val[0], *val1=val[1], *val0=val[2]; //diagonal s-2, s-1, s
+	tm_real *gap1=gap[0], *gap0=gap[1];                //diagonal s-1, s
+	for(s=2; s<=len1+len2; s++)
+	{
+		const int i_first=NW_diag_first(s, len2), i_last=NW_diag_last(s, len1);
+		const int y_start=len2-s;
+		path_start[s]=pos;
+		for(i=i_first; i<=i_last; i+=lanes)
+		{
+			vec d1=*(const uvec *)(xt.x+i-1)-*(const uvec *)(y.x+y_start+i);
+			vec d2=*(const uvec *)(xt.y+i-1)-*(const uvec *)(y.y+y_start+i);
+			vec d3=*(const uvec *)(xt.z+i-1)-*(const uvec *)(y.z+y_start+i);
+			vec dij=d1*d1 + d2*d2 + d3*d3;
+			vec d=*(const uvec *)(val2+i-1) + one/(one+dij/d02v);
+			vec h=*(const uvec *)(val1+i-1) + *(const uvec *)(gap1+i-1);
+			vec v=*(const uvec *)(val1+i) + *(const uvec *)(gap1+i);
+
+			vmask from_diag=(d>=h) & (d>=v), from_left=(v>=h);
+			*(uvec *)(val0+i)=from_diag?d:(from_left?v:h);
+			*(uvec *)(gap0+i)=from_diag?gap_openv:zero;
+			vcode code=__builtin_convertvector(
+				from_diag?code_diag:(from_left?code_left:code_up), vcode);
+			for(k=0; k<lanes; k+=4)
+				path[pos+((i-i_first+k)>>2)]=code[k]|(code[k+1]<<2)|
+					(code[k+2]<<4)|(code[k+3]<<6);
+		}
+		pos+=(i_last-i_first+4)>>2;
+
+		//cells (0,s) and (s,0) of the border, which the lanes past i_last
+		//may have overwritten
+		val0[0]=gap0[0]=0;
+		if(s<=len1) val0[s]=gap0[s]=0;
+
+		tm_real *next=val2;
+		val2=val1;
+		val1=val0;
+		val0=next;
+		next=gap1;
+		gap1=gap0;
+		gap0=next;
+	}
+}
@@ -38,6 +38,339 @@ using namespace std;
 #include "NW.h"
 #include "Kabsch.h"
 #include "TMalign.h"
+#include "structure_store.h"
+#include "work_steal.h"
+#include "unix_socket.h"
+#include <chrono>
+#include <condition_variable>
+
+/* wall time since start; clock() would add up the CPU time of all threads */
+void print_running_time(const chrono::steady_clock::time_point &start)
+{
+    chrono::duration<double> diff=chrono::steady_clock::now()-start;
+    printf("Total running time is %5.2f seconds\n", diff.count());
+}
+
+/* per-thread state of the chain1 x chain2 loop */
+struct pair_worker
+{
+    TMalign_ctx ctx;
+};
+
+/* one chain pair, kept until all pairs before it are printed */
+struct pair_result
+{
+    int stat;   // return value of load_PDB_allocate_memory
+    string out; // buffered output of TMalign_main
+};
+
+/* one chain pair to align */
+struct chain_pair
+{
+    int idx1, idx2;     // store index of chain1 and chain2
+    const char *name1;  // file name of chain1
+    const char *name2;  // file name of chain2
+    bool warn1;         // print the warning if chain1 cannot be read
+};
+
+/* align pairs on the threads of worker, taking them in the order of
+ * run_order, and print their output in the order of pairs */
+void align_pairs(vector<pair_worker> &worker, const structure_store &store,
+    const vector<chain_pair> &pairs, const vector<int> &run_order,
+    const char *fname_matrix, const int ter_opt, const string &dir1_opt,
+    const string &dir2_opt, const int outfmt_opt)
+{
+    int n_job=pairs.size();
+    vector<pair_result> result(n_job);
+    vector<char> done(n_job, 0);
+    int n_printed=0;
+    mutex print_lock;
+
+    run_work_stealing(n_job, worker.size(), [&](int r, int w)
+    {
+        pair_worker &pw=worker[w];
+        int k=run_order[r];
+        const chain_pair &cp=pairs[k];
+        pair_result &res=result[k];
+
+        /* load data */
+        res.stat=load_PDB_allocate_memory(pw.ctx,
+            store.chain[cp.idx1], store.chain[cp.idx2]);
+        if (res.stat==0)
+        {
+            /* entry function for structure alignment */
+            TMalign_main(pw.ctx, cp.name1, cp.name2, fname_matrix, ter_opt,
+                dir1_opt, dir2_opt, outfmt_opt);
+            res.out.swap(pw.ctx.out);
+
+            /* Done! Free memory */
+            free_memory(pw.ctx);
+        }
+
+        /* print all finished pairs that are next in serial order */
+        lock_guard<mutex> guard(print_lock);
+        done[k]=1;
+        for (;n_printed<n_job && done[n_printed];n_printed++)
+        {
+            pair_result &r=result[n_printed];
+            if (r.stat==1) // chain 1 failed
+            {
+                if (pairs[n_printed].warn1) cerr<<
+                    "Warning! Can not open file: "<<pairs[n_printed].name1<<endl;
+            }
+            else if (r.stat==2) // chain 2 failed
+                cerr<<"Warning! Can not open file: "<<pairs[n_printed].name2<<endl;
+            else cout<<r.out<<flush;
+            string().swap(r.out);
+        }
+    });
+}
+
+/* row i and column j of the p-th pair, where row_start[i] is the index of
+ * the first pair of row i */
+void pair_index(const vector<long long> &row_start, const long long p,
+    const bool all_opt, int &i, int &j)
+{
+    i=upper_bound(row_start.begin(), row_start.end(), p)-row_start.begin()-1;
+    j=p-row_start[i];
+    if (all_opt) j+=i+1;
+}
+
+/* -pairs: align the "chain1 chain2" pairs listed by file pair_list, which
+ * is read in blocks so that memory stays bounded. The structures of a block
+ * are parsed once, or taken from the previous block if it used them too.
+ * Pairs of a block run grouped by chain1 and are printed in file order. */
+void align_pair_file(vector<pair_worker> &worker, const char *pair_list,
+    const char *fname_matrix, const int ter_opt, const string &atom_opt,
+    const string &dir1_opt, const string &dir2_opt, const string &suffix_opt,
+    const int outfmt_opt)
+{
+    ifstream fp(pair_list);
+    if (! fp.is_open())
+    {
+        char message[5000];
+        sprintf(message, "Can not open file: %s\n", pair_list);
+        PrintErrorAndQuit(message);
+    }
+
+    const int n_block=32768;
+    structure_store store, prev_store;
+    vector<string> chain1_list, chain2_list;
+    vector<int> chain1_idx, chain2_idx;
+    vector<chain_pair> pairs;
+    vector<int> run_order;
+    string line, name1, name2;
+    while (fp.good())
+    {
+        /* read one block of pairs */
+        chain1_list.clear();
+        chain2_list.clear();
+        while (chain1_list.size()<n_block && getline(fp, line))
+        {
+            istringstream line_stream(line);
+            if (!(line_stream>>name1)) continue; // empty line
+            if (!(line_stream>>name2))
+            {
+                cerr<<"Warning! Wrong format of pair: "<<line<<endl;
+                continue;
+            }
+            chain1_list.push_back(dir1_opt+name1+suffix_opt);
+            chain2_list.push_back(dir2_opt+name2+suffix_opt);
+        }
+        if (chain1_list.size()==0) break;
+
+        /* parse each structure of the block once */
+        swap(store, prev_store);
+        free_store(store);
+        add_to_store(store, chain1_list, chain1_idx, ter_opt, atom_opt,
+            &prev_store);
+        add_to_store(store, chain2_list, chain2_idx, ter_opt, atom_opt,
+            &prev_store);
+        free_store(prev_store);
+
+        int n_job=chain1_list.size();
+        pairs.resize(n_job);
+        run_order.resize(n_job);
+        for (int k=0;k<n_job;k++)
+        {
+            pairs[k].idx1=chain1_idx[k];
+            pairs[k].idx2=chain2_idx[k];
+            pairs[k].name1=chain1_list[k].c_str();
+            pairs[k].name2=chain2_list[k].c_str();
+            pairs[k].warn1=true;
+            run_order[k]=k;
+        }
+        stable_sort(run_order.begin(), run_order.end(),
+            [&](const int a, const int b)
+            {
+                return pairs[a].idx1<pairs[b].idx1;
+            });
+        align_pairs(worker, store, pairs, run_order, fname_matrix, ter_opt,
+            dir1_opt, dir2_opt, outfmt_opt);
+    }
+    fp.close();
+    free_store(store);
+}
+
+/* answer one -server client: align its query to every chain of the database
+ * and send the outfmt 2 lines */
+void serve_client(const int fd, const TMalign_opt &opt,
+    const structure_store &store, const vector<string> &chain2_list,
+    const vector<int> &chain2_idx, const int ter_opt, const string &atom_opt,
+    const string &dir2_opt)
+{
+    string request, reply;
+    if (!recv_all(fd, request))
+    {
+        close(fd);
+        return;
+    }
+
+    /* the first line is the name of the query, then its PDB file */
+    istringstream fin(request);
+    string name;
+    getline(fin, name);
+    name=Trim(name);
+    if (name.size()==0) name="query";
+    vector<string> PDB_lines;
+    pdb_chain query;
+    pdb_chain_data query_data;
+    get_PDB_lines(fin, PDB_lines, ter_opt, atom_opt);
+    read_pdb_chain(PDB_lines, query, query_data);
+    if (query.len==0)
+    {
+        send_all(fd, "ERROR no residue is read from query "+name+"\n");
+        close(fd);
+        return;
+    }
+
+    TMalign_ctx ctx;
+    ctx.opt=&opt;
+    for (int j=0;j<chain2_list.size();j++)
+    {
+        if (load_PDB_allocate_memory(ctx, query, store.chain[chain2_idx[j]]))
+            continue; // chain 2 cannot be read
+        TMalign_main(ctx, name.c_str(), chain2_list[j].c_str(), "", ter_opt,
+            "", dir2_opt, 2);
+        reply+=ctx.out;
+        ctx.out.clear();
+        free_memory(ctx);
+
+        if (reply.size()>=65536) // stream long answers
+        {
+            if (!send_all(fd, reply)) break;
+            reply.clear();
+        }
+    }
+    send_all(fd, reply);
+    close(fd);
+}
+
+/* -server: keep the chains of -db2 or -dir2 in memory and answer queries
+ * sent to the Unix domain socket socket_path, one thread per client and at
+ * most max_client clients at once. Further clients wait in the backlog of
+ * the socket until a thread is free */
+void run_server(const char *socket_path, const TMalign_opt &opt,
+    const structure_store &store, const vector<string> &chain2_list,
+    const vector<int> &chain2_idx, const int ter_opt, const string &atom_opt,
+    const string &dir2_opt, const int max_client)
+{
+    int fd=listen_socket(socket_path);
+    if (fd<0)
+    {
+        char message[5000];
+        sprintf(message, "Can not listen at socket: %s (%s)\n", socket_path,
+            strerror(errno));
+        PrintErrorAndQuit(message);
+    }
+    cout<<"Serving "<<chain2_list.size()<<" chains at "<<socket_path<<endl;
+
+    mutex lock;
+    condition_variable slot_freed;
+    int n_client=0;  // clients being answered
+    int backoff=0;   // ms to wait after running out of descriptors or memory
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            slot_freed.wait(guard, [&](){ return n_client<max_client; });
+        }
+        int client=accept(fd, NULL, NULL);
+        if (client<0)
+        {
+            if (errno==EINTR || errno==ECONNABORTED) continue;
+            if (errno!=EMFILE && errno!=ENFILE && errno!=ENOBUFS &&
+                errno!=ENOMEM)
+            {
+                char message[5000];
+                sprintf(message, "Can not accept at socket: %s (%s)\n",
+                    socket_path, strerror(errno));
+                PrintErrorAndQuit(message);
+            }
+            backoff=(backoff)?getmin(2*backoff, 1000):10;
+            this_thread::sleep_for(chrono::milliseconds(backoff));
+            continue;
+        }
+        backoff=0;
+        {
+            lock_guard<mutex> guard(lock);
+            n_client++;
+        }
+        thread([&, client]()
+        {
+            serve_client(client, opt, store, chain2_list, chain2_idx,
+                ter_opt, atom_opt, dir2_opt);
+            {
+                lock_guard<mutex> guard(lock);
+                n_client--;
+            }
+            slot_freed.notify_one();
+        }).detach();
+    }
+}
+
+/* -shard: first pair of shard s of n_shard in the serial order of
+ * pair_index. Shards are contiguous ranges of the serial order, balanced by
+ * the cost xlen*ylen of each pair: pair p goes to shard
+ * floor(n_shard*cost_before(p)/total_cost). len1 holds the length of each
+ * chain1 and len2_sum the partial sums of the lengths of chain2. */
+long long shard_begin(const vector<long long> &row_start,
+    const vector<long long> &len1, const vector<long long> &len2_sum,
+    const bool all_opt, const int s, const int n_shard)
+{
+    int n_chain1=len1.size();
+    int n_chain2=len2_sum.size()-1;
+    if (s>=n_shard) return row_start[n_chain1];
+
+    long double total=0;
+    for (int i=0;i<n_chain1;i++)
+        total+=(long double)len1[i]*(len2_sum[n_chain2]-
+            len2_sum[all_opt?i+1:0]);
+    long double target=total*s/n_shard;
+
+    long double cost=0; // cost of all rows before row i
+    for (int i=0;i<n_chain1;i++)
+    {
+        int j0=all_opt?i+1:0;
+        long double row_cost=(long double)len1[i]*
+            (len2_sum[n_chain2]-len2_sum[j0]);
+        if (cost+row_cost>=target && row_start[i+1]>row_start[i])
+        {
+            /* first column j of row i with cost before it >= target */
+            int lo=j0, hi=n_chain2;
+            while (lo<hi)
+            {
+                int mid=(lo+hi)/2;
+                if (cost+(long double)len1[i]*(len2_sum[mid]-len2_sum[j0])
+                    >=target) hi=mid;
+                else lo=mid+1;
+            }
+            return row_start[i]+lo-j0;
+        }
+        cost+=row_cost;
+    }
+    return row_start[n_chain1];
+}
 
 void print_extra_help()
 {
@@ -53,8 +386,43 @@ void print_extra_help()
 "             under 'chain2_folder'\n"
 "             $ TMalign chain1 -dir2 chain2_folder/ chain2_list\n"
 "\n"
-"    -suffix  (Only when -dir1 and/or -dir2 are set, default is empty)\n"
-"             add file name suffix to files listed by chain1_list or chain2_list\n"
+"    -all-vs-all  Align every pair of PDB chains listed by 'chain_list' under\n"
+"             'chain_folder' once, and output each pair in both directions.\n"
+"             A chain is not aligned to itself.\n"
+"             $ TMalign -all-vs-all chain_folder/ chain_list\n"
+"\n"
+"    -db1     Use chain2 to search all PDB chains of database 'chain1_db',\n"
+"             which is made by TMdb\n"
+"             $ TMalign -db1 chain1_db chain2\n"
+"\n"
+"    -db2     Use chain1 to search all PDB chains of database 'chain2_db'\n"
+"             $ TMalign chain1 -db2 chain2_db\n"
+"\n"
+"    -pairs   Align the pairs of PDB chains listed by 'pair_list', one\n"
+"             \"chain1 chain2\" pair per line. -dir1 and -dir2 set the\n"
+"             folders of chain1 and chain2, respectively.\n"
+"             $ TMalign -pairs pair_list -dir1 chain1_folder/ -dir2 chain2_folder/\n"
+"\n"
+"    -server  Keep the PDB chains of -db2 or -dir2 in memory and answer the\n"
+"             queries sent by TMclient to Unix domain socket 'socket_path'\n"
+"             with outfmt 2 lines. A socket left at 'socket_path' by an\n"
+"             earlier server is replaced; any other file there is kept and\n"
+"             the server does not start. At most -threads clients, by\n"
+"             default one per CPU core, are answered at once.\n"
+"             $ TMalign -server socket_path -db2 chain2_db\n"
+"             $ TMclient socket_path chain1\n"
+"\n"
+"    -shard   Only align shard i of N (0<=i<N) of the chain pairs of -dir1,\n"
+"             -dir2, -db1, -db2 or -all-vs-all. Shards are balanced by the\n"
+"             estimated cost of each pair, xlen*ylen. TMmerge joins the\n"
+"             outfmt 2 outputs of all shards in the order of a single run.\n"
+"             $ TMalign chain1 -dir2 chain2_folder/ chain2_list -outfmt 2 -shard 0/2 > out0\n"
+"             $ TMalign chain1 -dir2 chain2_folder/ chain2_list -outfmt 2 -shard 1/2 > out1\n"
+"             $ TMmerge out0 out1\n"
+"\n"
+"    -suffix  (Only when -dir1, -dir2, -all-vs-all or -pairs are set, default\n"
+"             is empty) add file name suffix to files listed by chain1_list,\n"
+"             chain2_list or pair_list\n"
 "\n"
 "    -atom    4-character atom name used to represent a residue\n"
 "             default is \" CA \" (note the space before and after CA)\n"
@@ -69,6 +437,29 @@ void print_extra_help()
 "             0: (default) full output\n"
 "             1: fasta format compact output\n"
 "             2: tabular format very compact output\n"
+"\n"
+"    -threads Number of threads to align the chain pairs of -dir1/-dir2\n"
+"             (default 1). 0 means one thread per available core. The\n"
+"             output order is the same as with a single thread.\n"
+"             $ TMalign -dir1 chain1_folder/ chain1_list chain2 -threads 8\n"
+"             A single pair runs the superposition search of its final\n"
+"             alignment on the threads instead, as well as its dynamic\n"
+"             programming if the chains are long (xlen*ylen of 2 million or\n"
+"             more), with the same alignment.\n"
+"             $ TMalign chain1 chain2 -threads 8\n"
+"             With -server, it is the number of clients answered at once.\n"
+"\n"
+"    -dpmem   MB of memory for the moves of the dynamic programming of one\n"
+"             pair (default 1024). Longer pairs keep the DP rows of every\n"
+"             6*sqrt(xlen)th residue only and recompute the moves in between\n"
+"             for the traceback, which gives the same alignment in less\n"
+"             memory and somewhat more time. 0 always does so.\n"
+"             $ TMalign chain1 chain2 -dpmem 64\n"
+"\n"
+"    The dynamic programming of chains of 32 residues or more runs on the\n"
+"    AVX-512 or AVX2 vectors of the CPU, with the same alignment. CPUs with\n"
+"    SSE2 only, where vectors are no faster, and other platforms than x86-64\n"
+"    run it row by row.\n"
     <<endl;
 }
 
@@ -133,28 +524,39 @@ int main(int argc, char *argv[])
     if (argc < 2) print_help();
 
 
-    clock_t t1, t2;
-    t1 = clock();
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
 
     /**********************/
     /*    get argument    */
     /**********************/
+    TMalign_opt opt;   // options shared by all alignments
     char xname[MAXLEN], yname[MAXLEN],  Lnorm_ave[MAXLEN];
     bool A_opt, B_opt, h_opt=false;
     bool v_opt = false;
     int ter_opt = 3; // TER, END, or different chainID
     int outfmt_opt=0;  // set -outfmt to full output
-    A_opt = B_opt = o_opt = a_opt = u_opt = d_opt = false;
-    i_opt = false;// set -i flag to be false
-    m_opt = false;// set -m flag to be false
+    A_opt = B_opt = opt.o_opt = opt.a_opt = opt.u_opt = opt.d_opt = false;
+    opt.i_opt = false;// set -i flag to be false
+    opt.m_opt = false;// set -m flag to be false
     char fname_lign[MAXLEN] = "";
     char fname_matrix[MAXLEN] = "";// set names to ""
-    I_opt = false;// set -I flag to be false
-    fast_opt = false;// set -fast flag to be false
+    opt.I_opt = false;// set -I flag to be false
+    opt.fast_opt = false;// set -fast flag to be false
     string atom_opt=" CA "; // use C alpha atom to represent a residue
     string suffix_opt=""; // set -suffix to empty
     string dir1_opt="";   // set -dir1 to empty
     string dir2_opt="";   // set -dir2 to empty
+    string all_dir_opt="";// set -all-vs-all to empty
+    string db1_opt="";    // set -db1 to empty
+    string db2_opt="";    // set -db2 to empty
+    string pair_opt="";   // set -pairs to empty
+    string server_opt=""; // set -server to empty
+    int shard_idx=0, n_shard=0; // -shard i/N, no sharding if n_shard==0
+    opt.all_opt = false;  // set -all-vs-all flag to be false
+    opt.dp_mem = dp_mem_default; // MB of DP moves for a full path
+    opt.dp_threads = 1;   // threads of the DP of one pair
+    int thread_opt=1;     // number of threads for -dir1/-dir2 pairs
+    bool threads_set=false; // -threads is given
     vector<string> chain1_list; // only when -dir1 is set
     vector<string> chain2_list; // only when -dir2 is set
 
@@ -163,19 +565,19 @@ int main(int argc, char *argv[])
     {
         if ( !strcmp(argv[i],"-o") && i < (argc-1) )
         {
-            strcpy(out_reg, argv[i + 1]);      o_opt = true; i++;
+            strcpy(opt.out_reg, argv[i + 1]);      opt.o_opt = true; i++;
         }
         else if ( !strcmp(argv[i],"-u") && i < (argc-1) )
         {
-            Lnorm_ass = atof(argv[i + 1]); u_opt = true; i++;
+            opt.Lnorm_ass = atof(argv[i + 1]); opt.u_opt = true; i++;
         }
         else if ( !strcmp(argv[i],"-a") && i < (argc-1) )
         {
-            strcpy(Lnorm_ave, argv[i + 1]);     a_opt = true; i++;
+            strcpy(Lnorm_ave, argv[i + 1]);     opt.a_opt = true; i++;
         }
         else if ( !strcmp(argv[i],"-d") && i < (argc-1) )
         {
-            d0_scale = atof(argv[i + 1]); d_opt = true; i++;
+            opt.d0_scale = atof(argv[i + 1]); opt.d_opt = true; i++;
         }
         else if ( !strcmp(argv[i],"-v") )
         {
@@ -187,19 +589,19 @@ int main(int argc, char *argv[])
         }
         else if ( !strcmp(argv[i],"-i") && i < (argc-1) )
         {
-            strcpy(fname_lign, argv[i + 1]);      i_opt = true; i++;
+            strcpy(fname_lign, argv[i + 1]);      opt.i_opt = true; i++;
         }
         else if (!strcmp(argv[i], "-m") && i < (argc-1) )
         {
-            strcpy(fname_matrix, argv[i + 1]);      m_opt = true; i++;
+            strcpy(fname_matrix, argv[i + 1]);      opt.m_opt = true; i++;
         }// get filename for rotation matrix
         else if (!strcmp(argv[i], "-I") && i < (argc-1) )
         {
-            strcpy(fname_lign, argv[i + 1]);      I_opt = true; i++;
+            strcpy(fname_lign, argv[i + 1]);      opt.I_opt = true; i++;
         }
         else if (!strcmp(argv[i], "-fast"))
         {
-            fast_opt = true;
+            opt.fast_opt = true;
         }
         else if ( !strcmp(argv[i],"-ter") && i < (argc-1) )
         {
@@ -219,6 +621,33 @@ int main(int argc, char *argv[])
         {
             dir2_opt=argv[i + 1]; i++;
         }
+        else if ( !strcmp(argv[i],"-db1") && i < (argc-1) )
+        {
+            db1_opt=argv[i + 1]; i++;
+        }
+        else if ( !strcmp(argv[i],"-db2") && i < (argc-1) )
+        {
+            db2_opt=argv[i + 1]; i++;
+        }
+        else if ( !strcmp(argv[i],"-server") && i < (argc-1) )
+        {
+            server_opt=argv[i + 1]; i++;
+        }
+        else if ( !strcmp(argv[i],"-shard") && i < (argc-1) )
+        {
+            if (sscanf(argv[i + 1], "%d/%d", &shard_idx, &n_shard)!=2 ||
+                n_shard<1 || shard_idx<0 || shard_idx>=n_shard)
+                PrintErrorAndQuit("-shard should be i/N with 0<=i<N");
+            i++;
+        }
+        else if ( !strcmp(argv[i],"-pairs") && i < (argc-1) )
+        {
+            pair_opt=argv[i + 1]; i++;
+        }
+        else if ( !strcmp(argv[i],"-all-vs-all") && i < (argc-1) )
+        {
+            all_dir_opt=argv[i + 1]; opt.all_opt = true; i++;
+        }
         else if ( !strcmp(argv[i],"-suffix") && i < (argc-1) )
         {
             suffix_opt=argv[i + 1]; i++;
@@ -227,6 +656,20 @@ int main(int argc, char *argv[])
         {
             outfmt_opt=atoi(argv[i + 1]); i++;
         }
+        else if ( !strcmp(argv[i],"-dpmem") && i < (argc-1) )
+        {
+            opt.dp_mem=atof(argv[i + 1]); i++;
+            if (opt.dp_mem<0)
+                PrintErrorAndQuit("ERROR! -dpmem must be >=0.");
+        }
+        else if ( !strcmp(argv[i],"-threads") && i < (argc-1) )
+        {
+            thread_opt=atoi(argv[i + 1]); i++; threads_set=true;
+            if (thread_opt<0)
+                PrintErrorAndQuit("ERROR! -threads must be >=0.");
+            if (thread_opt==0) thread_opt=thread::hardware_concurrency();
+            if (thread_opt==0) thread_opt=1;
+        }
         else
         {
             if (nameIdx == 0)
@@ -241,6 +684,60 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (opt.all_opt)
+    {
+        if (dir1_opt.size() || dir2_opt.size())
+            PrintErrorAndQuit("-all-vs-all cannot be set with -dir1 or -dir2");
+        if (opt.i_opt || opt.I_opt)
+            PrintErrorAndQuit("-i or -I cannot be set with -all-vs-all");
+        if (B_opt && !A_opt) // both lists are chain_list
+        {
+            strcpy(yname, xname); A_opt = true;
+        }
+        dir1_opt=dir2_opt=all_dir_opt;
+    }
+
+    if (pair_opt.size())
+    {
+        if (nameIdx)
+            PrintErrorAndQuit("Structure A or B cannot be given with -pairs");
+        if (db1_opt.size() || db2_opt.size() || opt.all_opt)
+            PrintErrorAndQuit("-pairs cannot be set with -db1, -db2 or -all-vs-all");
+        if (opt.m_opt || opt.o_opt)
+            PrintErrorAndQuit("-m or -o cannot be set with -pairs");
+        A_opt = B_opt = true;
+    }
+
+    if (n_shard && (pair_opt.size() || server_opt.size()))
+        PrintErrorAndQuit("-shard cannot be set with -pairs or -server");
+
+    if (server_opt.size())
+    {
+        if (db2_opt.size()==0 && dir2_opt.size()==0)
+            PrintErrorAndQuit("-server needs the chains of -db2 or -dir2");
+        if (db1_opt.size() || dir1_opt.size() || opt.all_opt || pair_opt.size())
+            PrintErrorAndQuit("-server cannot be set with -db1, -dir1, -all-vs-all or -pairs");
+        if (opt.m_opt || opt.o_opt)
+            PrintErrorAndQuit("-m or -o cannot be set with -server");
+        if (nameIdx!=(dir2_opt.size()>0))
+            PrintErrorAndQuit("Please provide only chain2_list with -server -dir2, or nothing with -server -db2");
+        if (nameIdx) strcpy(yname, xname);
+        A_opt = B_opt = true;
+    }
+    else if (db1_opt.size() || db2_opt.size())
+    {
+        if ((db1_opt.size() && dir1_opt.size()) ||
+            (db2_opt.size() && dir2_opt.size()))
+            PrintErrorAndQuit("-db1 or -db2 cannot be set with -dir1 or -dir2 for the same chain");
+        if (opt.all_opt)
+            PrintErrorAndQuit("-db1 or -db2 cannot be set with -all-vs-all");
+        if (nameIdx+(db1_opt.size()>0)+(db2_opt.size()>0)!=2)
+            PrintErrorAndQuit("Please provide one structure besides -db1 or -db2, or none with both");
+        if (db1_opt.size() && nameIdx) // the only structure is B
+            strcpy(yname, xname);
+        A_opt = B_opt = true;
+    }
+
     if(!B_opt || !A_opt)
     {
 
@@ -258,19 +755,22 @@ int main(int argc, char *argv[])
     if( !B_opt )
         PrintErrorAndQuit("Please provide structure B");
 
-    if (suffix_opt.size() && dir1_opt.size()==0 && dir2_opt.size()==0)
-        PrintErrorAndQuit("-suffix is only valid if -dir1 or -dir2 is set");
-    if ((dir1_opt.size() || dir2_opt.size()) && (m_opt || o_opt))
+    if (suffix_opt.size() && dir1_opt.size()==0 && dir2_opt.size()==0 &&
+        pair_opt.size()==0)
+        PrintErrorAndQuit("-suffix is only valid if -dir1, -dir2 or -pairs is set");
+    if ((dir1_opt.size() || dir2_opt.size()) && (opt.m_opt || opt.o_opt))
         PrintErrorAndQuit("-m or -o cannot be set with -dir1 or -dir2");
+    if ((db1_opt.size() || db2_opt.size()) && (opt.m_opt || opt.o_opt))
+        PrintErrorAndQuit("-m or -o cannot be set with -db1 or -db2");
 
-    if( a_opt )
+    if( opt.a_opt )
     {
         if(!strcmp(Lnorm_ave, "T"))
         {
         }
         else if(!strcmp(Lnorm_ave, "F"))
         {
-            a_opt=false;
+            opt.a_opt=false;
         }
         else
         {
@@ -278,17 +778,17 @@ int main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
     }
-    if( u_opt )
+    if( opt.u_opt )
     {
-        if(Lnorm_ass<=0)
+        if(opt.Lnorm_ass<=0)
         {
             cout << "Wrong value for option -u!  It should be >0" << endl;
             exit(EXIT_FAILURE);
         }
     }
-    if( d_opt )
+    if( opt.d_opt )
     {
-        if(d0_scale<=0)
+        if(opt.d0_scale<=0)
         {
             cout << "Wrong value for option -d!  It should be >0" << endl;
             exit(EXIT_FAILURE);
@@ -298,7 +798,7 @@ int main(int argc, char *argv[])
     string basename = string(argv[0]);
     int idx = basename.find_last_of("\\");
     basename = basename.substr(0, idx + 1);
-    if (i_opt || I_opt)// Ask TM-align to start with an alignment,specified in fasta file 'align.txt'
+    if (opt.i_opt || opt.I_opt)// Ask TM-align to start with an alignment,specified in fasta file 'align.txt'
     {
         if (fname_lign == "")
         {
@@ -321,7 +821,7 @@ int main(int argc, char *argv[])
                 getline(fileIn, line);
                 if (line.compare(0, 1, ">") == 0)// Flag for a new structure
                 {
-                    strcpy(sequence[n_p], "");
+                    strcpy(opt.sequence[n_p], "");
                     n_p++;
                     if (n_p > 2)
                         bContinue = false;
@@ -330,7 +830,7 @@ int main(int argc, char *argv[])
                 {
                     if (n_p > 0 && line!="")
                     {
-                        strcat(sequence[n_p-1], line.c_str());
+                        strcat(opt.sequence[n_p-1], line.c_str());
                     }
                 }
             }
@@ -349,7 +849,7 @@ int main(int argc, char *argv[])
         }
         else
         {
-            if (strlen(sequence[0]) != strlen(sequence[1]))
+            if (strlen(opt.sequence[0]) != strlen(opt.sequence[1]))
             {
                 cout << "\nWarning: FASTA format may be wrong, the length in alignment should be equal respectively to the aligned proteins.\n";
                 exit(EXIT_FAILURE);
@@ -357,7 +857,7 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (m_opt)// Output TM - align rotation matrix: matrix.txt
+    if (opt.m_opt)// Output TM - align rotation matrix: matrix.txt
     {
         if (fname_matrix == "")
         {
@@ -367,7 +867,9 @@ int main(int argc, char *argv[])
     }
 
     /* parse file list */
-    if (dir1_opt.size()==0)
+    if (pair_opt.size() || server_opt.size()) ; // no chain1_list
+    else if (db1_opt.size()) ; // chain names are read from the database
+    else if (dir1_opt.size()==0)
         chain1_list.push_back(xname);
     else
     {
@@ -389,7 +891,8 @@ int main(int argc, char *argv[])
         line.clear();
     }
 
-    if (dir2_opt.size()==0)
+    if (pair_opt.size() || db2_opt.size()) ;
+    else if (dir2_opt.size()==0)
         chain2_list.push_back(yname);
     else
     {
@@ -411,49 +914,98 @@ int main(int argc, char *argv[])
         line.clear();
     }
 
+    /* parse every listed file once, or map the databases */
+    structure_store store;
+    vector<int> chain1_idx, chain2_idx;
+    if (db1_opt.size())
+        add_db_to_store(store, db1_opt.c_str(), chain1_list, chain1_idx);
+    else add_to_store(store, chain1_list, chain1_idx, ter_opt, atom_opt);
+    if (db2_opt.size())
+        add_db_to_store(store, db2_opt.c_str(), chain2_list, chain2_idx);
+    else add_to_store(store, chain2_list, chain2_idx, ter_opt, atom_opt);
+
+    if (server_opt.size())
+    {
+        int max_client=thread_opt;
+        if (!threads_set) max_client=thread::hardware_concurrency();
+        if (max_client<1) max_client=1;
+        run_server(server_opt.c_str(), opt, store, chain2_list, chain2_idx,
+            ter_opt, atom_opt, dir2_opt, max_client);
+    }
+
     /* loop over file names */
     if (outfmt_opt==2)
         cout<<"#PDBchain1\tPDBchain2\tTM1\tTM2\tRMSD\tID1\tID2\tIDali\tL1\tL2\tLali"<<endl;
+    if (outfmt_opt==2 && n_shard) // tells TMmerge where this output goes
+        cout<<"#shard\t"<<shard_idx<<'/'<<n_shard<<endl;
 
-    vector<string> PDB_lines1; // text of chain1
-    vector<string> PDB_lines2; // text of chain2
-    for (int i=0;i<chain1_list.size();i++)
+    vector<pair_worker> worker(thread_opt);
+    for (int w=0;w<thread_opt;w++) worker[w].ctx.opt=&opt;
+    if (pair_opt.size())
     {
-        strcpy(xname,chain1_list[i].c_str());
-        for (int j=0;j<chain2_list.size();j++)
-        {
-            strcpy(yname,chain2_list[j].c_str());
+        align_pair_file(worker, pair_opt.c_str(), fname_matrix, ter_opt,
+            atom_opt, dir1_opt, dir2_opt, suffix_opt, outfmt_opt);
+        print_running_time(t1);
+        return 0;
+    }
 
-            /* load data */
-            int stat=load_PDB_allocate_memory(xname, yname,
-                PDB_lines1, PDB_lines2, ter_opt, atom_opt);
-            if (stat==1) // chain 1 failed
-            {
-		        cerr<<"Warning! Can not open file: "<<xname<<endl;
-                break;
-            }
-            else if (stat==2) // chain 2 failed
-            {
-		        cerr<<"Warning! Can not open file: "<<yname<<endl;
-                continue;
-            }
+    /* pairs in serial order: row i holds chain1_list[i] against
+     * chain2_list[j] for all j, or for j>i only with -all-vs-all */
+    int n_chain1=chain1_list.size();
+    int n_chain2=chain2_list.size();
+    vector<long long> row_start(n_chain1+1, 0);
+    for (int i=0;i<n_chain1;i++)
+        row_start[i+1]=row_start[i]+(opt.all_opt?n_chain2-i-1:n_chain2);
+    long long n_pair=row_start[n_chain1];
 
-            /* entry function for structure alignment */
-            TMalign_main(xname, yname, fname_matrix, ter_opt, 
-                dir1_opt, dir2_opt, outfmt_opt);
+    /* with -shard, only run this shard's range of the serial order */
+    long long p_begin=0, p_end=n_pair;
+    if (n_shard)
+    {
+        vector<long long> len1(n_chain1), len2_sum(n_chain2+1, 0);
+        for (int i=0;i<n_chain1;i++)
+            len1[i]=max(store.chain[chain1_idx[i]].len, 1);
+        for (int j=0;j<n_chain2;j++)
+            len2_sum[j+1]=len2_sum[j]+max(store.chain[chain2_idx[j]].len, 1);
+        p_begin=shard_begin(row_start, len1, len2_sum, opt.all_opt,
+            shard_idx, n_shard);
+        p_end=shard_begin(row_start, len1, len2_sum, opt.all_opt,
+            shard_idx+1, n_shard);
+    }
 
-            /* Done! Free memory */
-            free_memory();
-            if (chain2_list.size()>1) PDB_lines2.clear();
-        }
-        PDB_lines1.clear();
+    /* a single pair has all threads for its DP and superposition search */
+    if (p_end-p_begin==1) opt.dp_threads=thread_opt;
+
+    /* pairs are scheduled in windows so that the buffered output of pairs
+     * finished ahead of their turn stays bounded */
+    const int n_window=1024*thread_opt;
+    vector<chain_pair> pairs;
+    vector<int> run_order;
+    for (long long p0=p_begin;p0<p_end;p0+=n_window)
+    {
+        int n_job=min((long long)n_window, p_end-p0);
+        pairs.resize(n_job);
+        run_order.resize(n_job);
+        for (int k=0;k<n_job;k++)
+        {
+            int i, j;
+            pair_index(row_start, p0+k, opt.all_opt, i, j);
+            pairs[k].idx1=chain1_idx[i];
+            pairs[k].idx2=chain2_idx[j];
+            pairs[k].name1=chain1_list[i].c_str();
+            pairs[k].name2=chain2_list[j].c_str();
+            // warn once per chain 1
+            pairs[k].warn1=(p0+k==row_start[i] || p0+k==p_begin);
+            run_order[k]=k;
+        }
+        align_pairs(worker, store, pairs, run_order, fname_matrix, ter_opt,
+            dir1_opt, dir2_opt, outfmt_opt);
     }
-    PDB_lines2.clear();
+    worker.clear();
+    free_store(store);
     chain1_list.clear();
     chain2_list.clear();
 
-    t2 = clock();
-    float diff = ((float)t2 - (float)t1)/CLOCKS_PER_SEC;
-    printf("Total running time is %5.2f seconds\n", diff);
+    print_running_time(t1);
     return 0;
 }
@@ -16,9 +16,9 @@
 #include "basic_define.h"
 #include <iomanip>
 
-void print_version()
+void print_version(ostream &out=cout)
 {
-    cout << 
+    out << 
 "\n"
 " *****************************************************************************\n"
 " * TM-align (Version "<< TMalign_version <<
@@ -29,110 +29,175 @@ void print_version()
     << endl;
 }
 
-int load_PDB_allocate_memory(const char *xname, const char *yname,
-    vector<string> &PDB_lines1, vector<string> &PDB_lines2,
-    const int ter_opt=3, const string atom_opt=" CA ")
+int load_PDB_allocate_memory(TMalign_ctx &ctx,
+    const pdb_chain &chain1, const pdb_chain &chain2)
 {
-    tempxlen=PDB_lines1.size();
-    tempylen=PDB_lines2.size();
-    if (!tempxlen) tempxlen=get_PDB_lines(xname,PDB_lines1,ter_opt,atom_opt);
-    if (!tempxlen) return 1; // fail to read chain1
-    if (!tempylen) tempylen=get_PDB_lines(yname,PDB_lines2,ter_opt,atom_opt);
-    if (!tempylen) return 2; // fail to read chain2
+    ctx.tempxlen=chain1.len;
+    ctx.tempylen=chain2.len;
+    if (!ctx.tempxlen) return 1; // fail to read chain1
+    if (!ctx.tempylen) return 2; // fail to read chain2
 
     //------allocate memory for x and y------>
-    NewArray(&xa, tempxlen, 3);
-    seqx = new char[tempxlen + 1];
-    secx = new int[tempxlen];
-    xresno = new int[tempxlen];
-
-    NewArray(&ya, tempylen, 3);
-    seqy = new char[tempylen + 1];
-    yresno = new int[tempylen];
-    secy = new int[tempylen];
-
-    // Get exact length
-    xlen = read_PDB(PDB_lines1, xa, seqx, xresno);
-    ylen = read_PDB(PDB_lines2, ya, seqy, yresno);
-    minlen = min(xlen, ylen);
+    //all arrays of the alignment are taken from ctx.arena, which keeps its
+    //memory for the next alignment
+    TMalign_arena &arena=ctx.arena;
+    arena_coord(arena, ctx.xa, ctx.tempxlen);
+    ctx.seqx = arena_alloc<char>(arena, ctx.tempxlen + 1);
+    ctx.secx = arena_alloc<int>(arena, ctx.tempxlen);
+    ctx.xresno = arena_alloc<int>(arena, ctx.tempxlen);
+
+    arena_coord(arena, ctx.ya, ctx.tempylen);
+    ctx.seqy = arena_alloc<char>(arena, ctx.tempylen + 1);
+    ctx.yresno = arena_alloc<int>(arena, ctx.tempylen);
+    ctx.secy = arena_alloc<int>(arena, ctx.tempylen);
+
+    // copy parsed chains
+    ctx.xlen = copy_pdb_chain(chain1, ctx.xa, ctx.seqx, ctx.xresno, ctx.secx);
+    ctx.ylen = copy_pdb_chain(chain2, ctx.ya, ctx.seqy, ctx.yresno, ctx.secy);
+    for (int i=0;i<2;i++)
+    {
+        ctx.xfrag[i]=chain1.frag[ctx.opt->fast_opt][i];
+        ctx.yfrag[i]=chain2.frag[ctx.opt->fast_opt][i];
+    }
+    ctx.minlen = min(ctx.xlen, ctx.ylen);
     
     //------allocate memory for other temporary varialbes------>
-    NewArray(&r1, minlen, 3);
-    NewArray(&r2, minlen, 3);
-    NewArray(&xtm, minlen, 3);
-    NewArray(&ytm, minlen, 3);
-    NewArray(&xt, xlen, 3);
-
-    NewArray(&score, xlen+1, ylen+1);
-    NewArray(&path, xlen+1, ylen+1);
-    NewArray(&val, xlen+1, ylen+1);  
+    arena_coord(arena, ctx.r1, ctx.minlen);
+    arena_coord(arena, ctx.r2, ctx.minlen);
+    arena_coord(arena, ctx.xtm, ctx.minlen);
+    arena_coord(arena, ctx.ytm, ctx.minlen);
+    arena_coord(arena, ctx.xt, ctx.xlen);
+
+    //the moves of all DP rows, unless they take more than -dpmem MB. The
+    //moves by diagonals of NWDP_diag take up to one byte more per diagonal
+    size_t path_size=(size_t)ctx.xlen*NW_path_stride(ctx.ylen)+
+        ctx.xlen+ctx.ylen+NW_LANES;
+    if (path_size<=ctx.opt->dp_mem*1048576)
+    {
+        ctx.dp_block = 0;
+        ctx.path = arena_alloc<unsigned char>(arena, path_size);
+    }
+    else
+    {
+        ctx.dp_block = NW_block_rows(ctx.xlen);
+        ctx.path = NULL;
+    }
+    ctx.val = arena_alloc<tm_real>(arena, ctx.ylen+1);
+    ctx.diag = arena_alloc<bool>(arena, ctx.ylen+1);
     return 0; // 0 for no error
 }
 
 
-void free_memory()
+void free_memory(TMalign_ctx &ctx)
 {
-    DeleteArray(&path, xlen+1);
-    DeleteArray(&val, xlen+1);
-    DeleteArray(&score, xlen+1);
-    DeleteArray(&xa, tempxlen);
-    DeleteArray(&xt, xlen);
-    DeleteArray(&ya, tempylen);
-    DeleteArray(&r1, minlen);
-    DeleteArray(&r2, minlen);
-    DeleteArray(&xtm, minlen);
-    DeleteArray(&ytm, minlen);
-   
-    delete [] seqx;
-    delete [] seqy;
-    delete [] secx;
-    delete [] secy;
-    delete [] xresno;
-    delete [] yresno;
+    arena_reset(ctx.arena); // the memory is kept for the next alignment
 }
 
 
+//the n pairs of residue k of x, superposed by r, and residue k of y: their
+//squared distances dis[k], and the sum of their scores 1/(1+dis[k]/d02)
+//over the pairs with dis[k]<=score_cut
+double score_superposed(const coord_array &x, const coord_array &y, int n,
+    const tm_rotation &r, tm_real d02, tm_real score_cut, tm_real dis[])
+{
+    double score_sum=0;
+    for (int k=0; k<n; k++)
+    {
+        tm_real xrot[3];
+        transform(r, x, k, xrot);
+        tm_real di=dist(xrot, y, k);
+        dis[k]=di;
+        if (di<=score_cut) score_sum+=1/(1+di/d02);
+    }
+    return score_sum;
+}
+
+#ifdef NW_DIAG_SIMD
+//score_superposed over NW_LANES pairs at a time. x and y may be slices of
+//chains, so the reads are unaligned and the last n%NW_LANES pairs are
+//left to the scalar loop
+__attribute__((target("avx512f")))
+double score_superposed_simd(const coord_array &x, const coord_array &y,
+    int n, const tm_rotation &r, tm_real d02, tm_real score_cut,
+    tm_real dis[])
+{
+    NW_vec sum=NW_vec();
+    const NW_vec one=NW_vec()+1, cut=NW_vec()+score_cut, d02v=NW_vec()+d02;
+    int k;
+    for (k=0; k+NW_LANES<=n; k+=NW_LANES)
+    {
+        NW_vec xx=*(const NW_uvec *)(x.x+k);
+        NW_vec xy=*(const NW_uvec *)(x.y+k);
+        NW_vec xz=*(const NW_uvec *)(x.z+k);
+        NW_vec dx=r.t[0]+(r.u[0][0]*xx + r.u[0][1]*xy + r.u[0][2]*xz)-
+            *(const NW_uvec *)(y.x+k);
+        NW_vec dy=r.t[1]+(r.u[1][0]*xx + r.u[1][1]*xy + r.u[1][2]*xz)-
+            *(const NW_uvec *)(y.y+k);
+        NW_vec dz=r.t[2]+(r.u[2][0]*xx + r.u[2][1]*xy + r.u[2][2]*xz)-
+            *(const NW_uvec *)(y.z+k);
+        NW_vec di=dx*dx+dy*dy+dz*dz;
+        *(NW_uvec *)(dis+k)=di;
+        sum+=(di<=cut)?one/(one+di/d02v):NW_vec();
+    }
+    double score_sum=0;
+    for (int l=0; l<NW_LANES; l++) score_sum+=sum[l];
+    return score_sum+score_superposed(coord_slice(x, k), coord_slice(y, k),
+        n-k, r, d02, score_cut, dis+k);
+}
+#endif
+
+//score_cut of score_superposed to score all pairs
+const tm_real score_cut_none=1e30;
+
+//score_superposed on the fastest kernel of this CPU
+inline double score_superposed_fast(const coord_array &x,
+    const coord_array &y, int n, const tm_rotation &r, tm_real d02,
+    tm_real score_cut, tm_real dis[])
+{
+#ifdef NW_DIAG_SIMD
+    if (NW_avx512_supported())
+        return score_superposed_simd(x, y, n, r, d02, score_cut, dis);
+#endif
+    return score_superposed(x, y, n, r, d02, score_cut, dis);
+}
+
 //     1, collect those residues with dis<d;
 //     2, calculate TMscore
-int score_fun8( double **xa, 
-                double **ya, 
+//of the n_ali pairs (xa[k] superposed by t, u, ya[k])
+int score_fun8( TMalign_ctx &ctx,
+                const coord_array &xa, 
+                const coord_array &ya, 
                 int n_ali,
+                double t[3],
+                double u[3][3],
                 double d,
                 int i_ali[], 
                 double *score1,
                 int score_sum_method
               )
 {
-    double score_sum=0, di;
-    double d_tmp=d*d;
-    double d02=d0*d0;
-    double score_d8_cut = score_d8*score_d8;
+    double score_sum=0;
+    tm_real d_tmp=d*d;
+    const tm_real d02=ctx.d0*ctx.d0;
+    const tm_real score_d8_cut = (score_sum_method==8)?
+        ctx.score_d8*ctx.score_d8:score_cut_none;
+    size_t mark=arena_mark(ctx.arena);
+    tm_real *dis=arena_alloc<tm_real>(ctx.arena, n_ali);
     
     int i, n_cut, inc=0;
 
+    score_sum=score_superposed_fast(xa, ya, n_ali, tm_rotation(t, u), d02,
+        score_d8_cut, dis);
     while(1)
     {
         n_cut=0;
-        score_sum=0;
         for(i=0; i<n_ali; i++)
         {
-            di = dist(xa[i], ya[i]);
-            if(di<d_tmp)
+            if(dis[i]<d_tmp)
             {
                 i_ali[n_cut]=i;
                 n_cut++;
             }
-            if(score_sum_method==8)
-            {                
-                if(di<=score_d8_cut)
-                {                    
-                    score_sum += 1/(1+di/d02);
-                }                
-            }
-            else
-            {
-                score_sum += 1/(1+di/d02);
-            }
         }
         //there are not enough feasible pairs, reliefe the threshold         
         if(n_cut<3 && n_ali>3)
@@ -148,49 +213,44 @@ int score_fun8( double **xa,
 
     }  
 
-    *score1=score_sum/Lnorm;
+    *score1=score_sum/ctx.Lnorm;
+    arena_release(ctx.arena, mark);
     
     return n_cut;
 }
 
-int score_fun8_standard(double **xa,
-    double **ya,
+int score_fun8_standard(TMalign_ctx &ctx, const coord_array &xa,
+    const coord_array &ya,
     int n_ali,
+    double t[3],
+    double u[3][3],
     double d,
     int i_ali[],
     double *score1,
     int score_sum_method
     )
 {
-    double score_sum = 0, di;
-    double d_tmp = d*d;
-    double d02 = d0*d0;
-    double score_d8_cut = score_d8*score_d8;
+    double score_sum = 0;
+    tm_real d_tmp = d*d;
+    const tm_real d02 = ctx.d0*ctx.d0;
+    const tm_real score_d8_cut = (score_sum_method == 8) ?
+        ctx.score_d8*ctx.score_d8 : score_cut_none;
+    size_t mark = arena_mark(ctx.arena);
+    tm_real *dis = arena_alloc<tm_real>(ctx.arena, n_ali);
 
     int i, n_cut, inc = 0;
+    score_sum = score_superposed_fast(xa, ya, n_ali, tm_rotation(t, u), d02,
+        score_d8_cut, dis);
     while (1)
     {
         n_cut = 0;
-        score_sum = 0;
         for (i = 0; i<n_ali; i++)
         {
-            di = dist(xa[i], ya[i]);
-            if (di<d_tmp)
+            if (dis[i]<d_tmp)
             {
                 i_ali[n_cut] = i;
                 n_cut++;
             }
-            if (score_sum_method == 8)
-            {
-                if (di <= score_d8_cut)
-                {
-                    score_sum += 1 / (1 + di / d02);
-                }
-            }
-            else
-            {
-                score_sum += 1 / (1 + di / d02);
-            }
         }
         //there are not enough feasible pairs, reliefe the threshold         
         if (n_cut<3 && n_ali>3)
@@ -207,32 +267,155 @@ int score_fun8_standard(double **xa,
     }
 
     *score1 = score_sum / n_ali;
+    arena_release(ctx.arena, mark);
     return n_cut;
 }
 
-double TMscore8_search( double **xtm, 
-                        double **ytm,
+//score function of the search from the seeds: score_fun8 or
+//score_fun8_standard
+typedef int (*TMscore8_score_fun)(TMalign_ctx &, const coord_array &,
+    const coord_array &, int, double [3], double [3][3], double, int [],
+    double *, int);
+
+//the search of TMscore8_search from the fragment of L_frag pairs at i and
+//its extensions: their best score, and the first superposition t0, u0 with
+//that score. Only ctx.r1, ctx.r2 and ctx.arena are written
+double TMscore8_seed(TMalign_ctx &ctx,
+                     const coord_array &xtm,
+                     const coord_array &ytm,
+                     int Lali,
+                     int i,
+                     int L_frag,
+                     int score_sum_method,
+                     double local_d0_search,
+                     TMscore8_score_fun score_fun,
+                     double t0[3],
+                     double u0[3][3]
+                    )
+{
+    int m;
+    double score_max=-1, score, rmsd;
+    size_t mark=arena_mark(ctx.arena);
+    int *k_ali=arena_alloc<int>(ctx.arena, Lali), ka, k;
+    int *i_ali=arena_alloc<int>(ctx.arena, Lali), n_cut;
+    double t[3];
+    double u[3][3];
+    double d;
+    int n_it=20;            //maximum number of iterations
+
+    //extract the fragment starting from position i 
+    ka=0;
+    for(k=0; k<L_frag; k++)
+    {
+        int kk=k+i;
+        copy_coord(ctx.r1, k, xtm, kk);
+        
+        copy_coord(ctx.r2, k, ytm, kk);
+        
+        k_ali[ka]=kk;
+        ka++;
+    }
+    
+    //extract rotation matrix based on the fragment
+    Kabsch(ctx.r1, ctx.r2, L_frag, 1, &rmsd, t, u);
+    
+    //get subsegment of this fragment
+    d = local_d0_search - 1;
+    n_cut=score_fun(ctx, xtm, ytm, Lali, t, u, d, i_ali, &score, score_sum_method);
+    if(score>score_max)
+    {
+        score_max=score;
+        
+        //save the rotation matrix
+        for(k=0; k<3; k++)
+        {
+            t0[k]=t[k];
+            u0[k][0]=u[k][0];
+            u0[k][1]=u[k][1];
+            u0[k][2]=u[k][2];
+        }
+    }
+    
+    //try to extend the alignment iteratively            
+    d = local_d0_search + 1;
+    for(int it=0; it<n_it; it++)            
+    {
+        ka=0;
+        for(k=0; k<n_cut; k++)
+        {
+            m=i_ali[k];
+            copy_coord(ctx.r1, k, xtm, m);
+            
+            copy_coord(ctx.r2, k, ytm, m);
+            
+            k_ali[ka]=m;
+            ka++;
+        } 
+        //extract rotation matrix based on the fragment                
+        Kabsch(ctx.r1, ctx.r2, n_cut, 1, &rmsd, t, u);
+        n_cut=score_fun(ctx, xtm, ytm, Lali, t, u, d, i_ali, &score, score_sum_method);
+        if(score>score_max)
+        {
+            score_max=score;
+
+            //save the rotation matrix
+            for(k=0; k<3; k++)
+            {
+                t0[k]=t[k];
+                u0[k][0]=u[k][0];
+                u0[k][1]=u[k][1];
+                u0[k][2]=u[k][2];
+            }                     
+        }
+        
+        //check if it converges            
+        if(n_cut==ka)
+        {                
+            for(k=0; k<n_cut; k++)
+            {
+                if(i_ali[k]!=k_ali[k])
+                {
+                    break;
+                }
+            }
+            if(k==n_cut)
+            {                        
+                break; //stop iteration
+            }
+        }                                                               
+    } //for iteration            
+    arena_release(ctx.arena, mark);
+    return score_max;
+}
+
+//least seeds times Lali for which TMscore8_search_seeds runs on
+//ctx.opt->dp_threads threads, e.g. the simplify_step 1 search of the
+//final alignment of a pair of 250 residues
+const double TMscore8_threads_min_work=65536;
+
+//TMscore8_search and TMscore8_search_standard. Each fragment is the seed
+//of an independent search by TMscore8_seed; with threads, thread w takes
+//seeds w, w+n_thread, ... on a context of its own. The best superposition
+//is then taken over the seeds in order, as in a single pass over them
+double TMscore8_search_seeds(TMalign_ctx &ctx,
+                        const coord_array &xtm, 
+                        const coord_array &ytm,
                         int Lali, 
                         double t0[3],
                         double u0[3][3],
                         int simplify_step,
                         int score_sum_method,
                         double *Rcomm,
-                        double local_d0_search
+                        double local_d0_search,
+                        TMscore8_score_fun score_fun
                        )
 { 
-    int i, m;
-    double score_max, score, rmsd;    
-    const int kmax=Lali;    
-    int k_ali[kmax], ka, k;
-    double t[3];
-    double u[3][3];
-    double d;
-    
+    int i, w;
+    double score_max;
+    size_t mark=arena_mark(ctx.arena);
 
     //iterative parameters
-    int n_it=20;            //maximum number of iterations
-    int n_init_max=6; //maximum number of different fragment length 
+    const int n_init_max=6; //maximum number of different fragment length 
     int L_ini[n_init_max];  //fragment lengths, Lali, Lali/2, Lali/4 ... 4   
     int L_ini_min=4;
     if(Lali<L_ini_min) L_ini_min=Lali;   
@@ -253,13 +436,13 @@ double TMscore8_search( double **xtm,
         n_init++;
         L_ini[i]=L_ini_min;
     }
-    
-    score_max=-1;
-    //find the maximum score starting from local structures superposition
-    int i_ali[kmax], n_cut;
+    if (simplify_step != 1)
+        *Rcomm = 0;
+
+    //seeds in the order of the search: fragment length and start position
+    vector<int> seed_L, seed_i;
     int L_frag; //fragment length
     int iL_max; //maximum starting postion for the fragment
-    
     for(i_init=0; i_init<n_init; i_init++)
     {
         L_frag=L_ini[i_init];
@@ -268,100 +451,8 @@ double TMscore8_search( double **xtm,
         i=0;   
         while(1)
         {
-            //extract the fragment starting from position i 
-            ka=0;
-            for(k=0; k<L_frag; k++)
-            {
-                int kk=k+i;
-                r1[k][0]=xtm[kk][0];  
-                r1[k][1]=xtm[kk][1]; 
-                r1[k][2]=xtm[kk][2];   
-                
-                r2[k][0]=ytm[kk][0];  
-                r2[k][1]=ytm[kk][1]; 
-                r2[k][2]=ytm[kk][2];
-                
-                k_ali[ka]=kk;
-                ka++;
-            }
-            
-            //extract rotation matrix based on the fragment
-            Kabsch(r1, r2, L_frag, 1, &rmsd, t, u);
-            if (simplify_step != 1)
-                *Rcomm = 0;
-            do_rotation(xtm, xt, Lali, t, u);
-            
-            //get subsegment of this fragment
-            d = local_d0_search - 1;
-            n_cut=score_fun8(xt, ytm, Lali, d, i_ali, &score, score_sum_method);
-            if(score>score_max)
-            {
-                score_max=score;
-                
-                //save the rotation matrix
-                for(k=0; k<3; k++)
-                {
-                    t0[k]=t[k];
-                    u0[k][0]=u[k][0];
-                    u0[k][1]=u[k][1];
-                    u0[k][2]=u[k][2];
-                }
-            }
-            
-            //try to extend the alignment iteratively            
-            d = local_d0_search + 1;
-            for(int it=0; it<n_it; it++)            
-            {
-                ka=0;
-                for(k=0; k<n_cut; k++)
-                {
-                    m=i_ali[k];
-                    r1[k][0]=xtm[m][0];  
-                    r1[k][1]=xtm[m][1]; 
-                    r1[k][2]=xtm[m][2];
-                    
-                    r2[k][0]=ytm[m][0];  
-                    r2[k][1]=ytm[m][1]; 
-                    r2[k][2]=ytm[m][2];
-                    
-                    k_ali[ka]=m;
-                    ka++;
-                } 
-                //extract rotation matrix based on the fragment                
-                Kabsch(r1, r2, n_cut, 1, &rmsd, t, u);
-                do_rotation(xtm, xt, Lali, t, u);
-                n_cut=score_fun8(xt, ytm, Lali, d, i_ali, &score, score_sum_method);
-                if(score>score_max)
-                {
-                    score_max=score;
-
-                    //save the rotation matrix
-                    for(k=0; k<3; k++)
-                    {
-                        t0[k]=t[k];
-                        u0[k][0]=u[k][0];
-                        u0[k][1]=u[k][1];
-                        u0[k][2]=u[k][2];
-                    }                     
-                }
-                
-                //check if it converges            
-                if(n_cut==ka)
-                {                
-                    for(k=0; k<n_cut; k++)
-                    {
-                        if(i_ali[k]!=k_ali[k])
-                        {
-                            break;
-                        }
-                    }
-                    if(k==n_cut)
-                    {                        
-                        break; //stop iteration
-                    }
-                }                                                               
-            } //for iteration            
-
+            seed_L.push_back(L_frag);
+            seed_i.push_back(i);
             if(i<iL_max)
             {
                 i=i+simplify_step; //shift the fragment        
@@ -371,15 +462,79 @@ double TMscore8_search( double **xtm,
             {
                 break;
             }
-        }//while(1)
-        //end of one fragment
-    }//for(i_init
+        }
+    }
+    const int n_seed=seed_L.size();
+    double *seed_score=arena_alloc<double>(ctx.arena, n_seed);
+    double (*seed_t)[3]=arena_alloc<double[3]>(ctx.arena, n_seed);
+    double (*seed_u)[3][3]=arena_alloc<double[3][3]>(ctx.arena, n_seed);
+
+    int n_thread=ctx.opt->dp_threads;
+    if((double)n_seed*Lali<TMscore8_threads_min_work) n_thread=1;
+    if(n_thread>n_seed) n_thread=n_seed;
+    auto search=[&](TMalign_ctx &seed_ctx, int w)
+    {
+        for(int s=w; s<n_seed; s+=n_thread)
+            seed_score[s]=TMscore8_seed(seed_ctx, xtm, ytm, Lali, seed_i[s],
+                seed_L[s], score_sum_method, local_d0_search, score_fun,
+                seed_t[s], seed_u[s]);
+    };
+    vector<TMalign_ctx> worker_ctx(n_thread-1);
+    vector<thread> pool;
+    for(w=1; w<n_thread; w++)
+    {
+        TMalign_ctx &wctx=worker_ctx[w-1];
+        wctx.opt=ctx.opt;
+        wctx.Lnorm=ctx.Lnorm;
+        wctx.d0=ctx.d0;
+        wctx.score_d8=ctx.score_d8;
+        arena_coord(wctx.arena, wctx.r1, Lali);
+        arena_coord(wctx.arena, wctx.r2, Lali);
+        pool.push_back(thread(search, ref(wctx), w));
+    }
+    search(ctx, 0);
+    for(w=1; w<n_thread; w++) pool[w-1].join();
+
+    //find the maximum score starting from local structures superposition
+    score_max=-1;
+    for(int s=0; s<n_seed; s++)
+    {
+        if(seed_score[s]>score_max)
+        {
+            score_max=seed_score[s];
+            
+            //save the rotation matrix
+            for(int k=0; k<3; k++)
+            {
+                t0[k]=seed_t[s][k];
+                u0[k][0]=seed_u[s][k][0];
+                u0[k][1]=seed_u[s][k][1];
+                u0[k][2]=seed_u[s][k][2];
+            }
+        }
+    }
+    arena_release(ctx.arena, mark);
     return score_max;
 }
 
+double TMscore8_search( TMalign_ctx &ctx,
+                        const coord_array &xtm, 
+                        const coord_array &ytm,
+                        int Lali, 
+                        double t0[3],
+                        double u0[3][3],
+                        int simplify_step,
+                        int score_sum_method,
+                        double *Rcomm,
+                        double local_d0_search
+                       )
+{ 
+    return TMscore8_search_seeds(ctx, xtm, ytm, Lali, t0, u0, simplify_step,
+        score_sum_method, Rcomm, local_d0_search, score_fun8);
+}
 
-double TMscore8_search_standard(double **xtm,
-    double **ytm,
+double TMscore8_search_standard(TMalign_ctx &ctx, const coord_array &xtm,
+    const coord_array &ytm,
     int Lali,
     double t0[3],
     double u0[3][3],
@@ -389,160 +544,8 @@ double TMscore8_search_standard(double **xtm,
     double local_d0_search
     )
 {
-    int i, m;
-    double score_max, score, rmsd;
-    const int kmax = Lali;
-    int k_ali[kmax], ka, k;
-    double t[3];
-    double u[3][3];
-    double d;
-
-
-    //iterative parameters
-    int n_it = 20;            //maximum number of iterations
-    int n_init_max = 6; //maximum number of different fragment length 
-    int L_ini[n_init_max];  //fragment lengths, Lali, Lali/2, Lali/4 ... 4   
-    int L_ini_min = 4;
-    if (Lali<L_ini_min) L_ini_min = Lali;
-
-    int n_init = 0, i_init;
-    for (i = 0; i<n_init_max - 1; i++)
-    {
-        n_init++;
-        L_ini[i] = (int)(Lali / pow(2.0, (double)i));
-        if (L_ini[i] <= L_ini_min)
-        {
-            L_ini[i] = L_ini_min;
-            break;
-        }
-    }
-    if (i == n_init_max - 1)
-    {
-        n_init++;
-        L_ini[i] = L_ini_min;
-    }
-
-    score_max = -1;
-    //find the maximum score starting from local structures superposition
-    int i_ali[kmax], n_cut;
-    int L_frag; //fragment length
-    int iL_max; //maximum starting postion for the fragment
-
-    for (i_init = 0; i_init<n_init; i_init++)
-    {
-        L_frag = L_ini[i_init];
-        iL_max = Lali - L_frag;
-
-        i = 0;
-        while (1)
-        {
-            //extract the fragment starting from position i 
-            ka = 0;
-            for (k = 0; k<L_frag; k++)
-            {
-                int kk = k + i;
-                r1[k][0] = xtm[kk][0];
-                r1[k][1] = xtm[kk][1];
-                r1[k][2] = xtm[kk][2];
-
-                r2[k][0] = ytm[kk][0];
-                r2[k][1] = ytm[kk][1];
-                r2[k][2] = ytm[kk][2];
-
-                k_ali[ka] = kk;
-                ka++;
-            }
-            //extract rotation matrix based on the fragment
-            Kabsch(r1, r2, L_frag, 1, &rmsd, t, u);
-            if (simplify_step != 1)
-                *Rcomm = 0;
-            do_rotation(xtm, xt, Lali, t, u);
-
-            //get subsegment of this fragment
-            d = local_d0_search - 1;
-            n_cut = score_fun8_standard(xt, ytm, Lali, d, i_ali, &score, score_sum_method);
-
-            if (score>score_max)
-            {
-                score_max = score;
-
-                //save the rotation matrix
-                for (k = 0; k<3; k++)
-                {
-                    t0[k] = t[k];
-                    u0[k][0] = u[k][0];
-                    u0[k][1] = u[k][1];
-                    u0[k][2] = u[k][2];
-                }
-            }
-
-            //try to extend the alignment iteratively            
-            d = local_d0_search + 1;
-            for (int it = 0; it<n_it; it++)
-            {
-                ka = 0;
-                for (k = 0; k<n_cut; k++)
-                {
-                    m = i_ali[k];
-                    r1[k][0] = xtm[m][0];
-                    r1[k][1] = xtm[m][1];
-                    r1[k][2] = xtm[m][2];
-
-                    r2[k][0] = ytm[m][0];
-                    r2[k][1] = ytm[m][1];
-                    r2[k][2] = ytm[m][2];
-
-                    k_ali[ka] = m;
-                    ka++;
-                }
-                //extract rotation matrix based on the fragment                
-                Kabsch(r1, r2, n_cut, 1, &rmsd, t, u);
-                do_rotation(xtm, xt, Lali, t, u);
-                n_cut = score_fun8_standard(xt, ytm, Lali, d, i_ali, &score, score_sum_method);
-                if (score>score_max)
-                {
-                    score_max = score;
-
-                    //save the rotation matrix
-                    for (k = 0; k<3; k++)
-                    {
-                        t0[k] = t[k];
-                        u0[k][0] = u[k][0];
-                        u0[k][1] = u[k][1];
-                        u0[k][2] = u[k][2];
-                    }
-                }
-
-                //check if it converges            
-                if (n_cut == ka)
-                {
-                    for (k = 0; k<n_cut; k++)
-                    {
-                        if (i_ali[k] != k_ali[k])
-                        {
-                            break;
-                        }
-                    }
-                    if (k == n_cut)
-                    {
-                        break; //stop iteration
-                    }
-                }
-            } //for iteration            
-
-            if (i<iL_max)
-            {
-                i = i + simplify_step; //shift the fragment        
-                if (i>iL_max) i = iL_max;  //do this to use the last missed fragment
-            }
-            else if (i >= iL_max)
-            {
-                break;
-            }
-        }//while(1)
-        //end of one fragment
-    }//for(i_init
-    return score_max;
+    return TMscore8_search_seeds(ctx, xtm, ytm, Lali, t0, u0, simplify_step,
+        score_sum_method, Rcomm, local_d0_search, score_fun8_standard);
 }
 
 //Comprehensive TMscore search engine
@@ -552,8 +555,9 @@ double TMscore8_search_standard(double **xtm,
 //          score_sum_method: 0 for score over all pairs
 //                            8 for socre over the pairs with dist<score_d8          
 // output:  the best rotaion matrix t, u that results in highest TMscore
-double detailed_search( double **x,
-                        double **y, 
+double detailed_search( TMalign_ctx &ctx,
+                        const coord_array &x,
+                        const coord_array &y, 
                         int x_len, 
                         int y_len, 
                         int invmap0[],
@@ -577,24 +581,20 @@ double detailed_search( double **x,
         j=invmap0[i];
         if(j>=0) //aligned
         {
-            xtm[k][0]=x[j][0];
-            xtm[k][1]=x[j][1];
-            xtm[k][2]=x[j][2];
+            copy_coord(ctx.xtm, k, x, j);
                 
-            ytm[k][0]=y[i][0];
-            ytm[k][1]=y[i][1];
-            ytm[k][2]=y[i][2];
+            copy_coord(ctx.ytm, k, y, i);
             k++;
         }
     }
 
     //detailed search 40-->1
-    tmscore = TMscore8_search(xtm, ytm, k, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
+    tmscore = TMscore8_search(ctx, ctx.xtm, ctx.ytm, k, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
     return tmscore;
 }
 
-double detailed_search_standard(double **x,
-                        double **y, 
+double detailed_search_standard(TMalign_ctx &ctx, const coord_array &x,
+                        const coord_array &y, 
                         int x_len, 
                         int y_len, 
                         int invmap0[],
@@ -619,80 +619,40 @@ double detailed_search_standard(double **x,
         j=invmap0[i];
         if(j>=0) //aligned
         {
-            xtm[k][0]=x[j][0];
-            xtm[k][1]=x[j][1];
-            xtm[k][2]=x[j][2];
+            copy_coord(ctx.xtm, k, x, j);
                 
-            ytm[k][0]=y[i][0];
-            ytm[k][1]=y[i][1];
-            ytm[k][2]=y[i][2];
+            copy_coord(ctx.ytm, k, y, i);
             k++;
         }
     }
 
     //detailed search 40-->1
-    tmscore = TMscore8_search_standard(xtm, ytm, k, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
+    tmscore = TMscore8_search_standard(ctx, ctx.xtm, ctx.ytm, k, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
     if (bNormalize)// "-i", to use standard_TMscore, then bNormalize=true, else bNormalize=false; 
-        tmscore = tmscore * k / Lnorm;
+        tmscore = tmscore * k / ctx.Lnorm;
 
     return tmscore;
 }
 
-//compute the score quickly in three iterations
-double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[])
+//compute the score of the n_ali aligned pairs (xtm[k], ytm[k]) quickly in
+//three iterations. xtm and ytm are only read, so they may be slices of the
+//chains themselves
+double get_score_fast(TMalign_ctx &ctx, const coord_array &xtm, const coord_array &ytm, int n_ali)
 {
     double rms, tmscore, tmscore1, tmscore2;
-    int i, j, k;
-
-    k=0;
-    for(j=0; j<y_len; j++)
-    {
-        i=invmap[j];
-        if(i>=0)
-        {
-            r1[k][0]=x[i][0];
-            r1[k][1]=x[i][1];
-            r1[k][2]=x[i][2];
+    int j, k;
 
-            r2[k][0]=y[j][0];
-            r2[k][1]=y[j][1];
-            r2[k][2]=y[j][2];
-            
-            xtm[k][0]=x[i][0];
-            xtm[k][1]=x[i][1];
-            xtm[k][2]=x[i][2];
-            
-            ytm[k][0]=y[j][0];
-            ytm[k][1]=y[j][1];
-            ytm[k][2]=y[j][2];                  
-            
-            k++;
-        }
-        else if(i!=-1)
-        {
-            PrintErrorAndQuit("Wrong map!\n");
-        }       
-    }
-    Kabsch(r1, r2, k, 1, &rms, t, u);
+    Kabsch(xtm, ytm, n_ali, 1, &rms, ctx.t, ctx.u);
     
     //evaluate score   
-    double di;
-    const int len=k;
-    double dis[len];    
-    double d00=d0_search;
+    size_t mark=arena_mark(ctx.arena);
+    tm_real *dis=arena_alloc<tm_real>(ctx.arena, n_ali);
+    double d00=ctx.d0_search;
     double d002=d00*d00;
-    double d02=d0*d0;
+    const tm_real d02=ctx.d0*ctx.d0;
     
-    int n_ali=k;
-    double xrot[3];
-    tmscore=0;
-    for(k=0; k<n_ali; k++)
-    {
-        transform(t, u, &xtm[k][0], xrot);        
-        di=dist(xrot, &ytm[k][0]);
-        dis[k]=di;
-        tmscore += 1/(1+di/d02);
-    }
+    tmscore=score_superposed_fast(xtm, ytm, n_ali, tm_rotation(ctx.t, ctx.u),
+        d02, score_cut_none, dis);
     
    
    
@@ -705,13 +665,9 @@ double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[]
         {            
             if(dis[k]<=d002t)
             {
-                r1[j][0]=xtm[k][0];
-                r1[j][1]=xtm[k][1];
-                r1[j][2]=xtm[k][2];
+                copy_coord(ctx.r1, j, xtm, k);
                 
-                r2[j][0]=ytm[k][0];
-                r2[j][1]=ytm[k][1];
-                r2[j][2]=ytm[k][2];
+                copy_coord(ctx.r2, j, ytm, k);
                 
                 j++;
             }
@@ -729,15 +685,9 @@ double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[]
     
     if(n_ali!=j)
     {
-        Kabsch(r1, r2, j, 1, &rms, t, u);
-        tmscore1=0;
-        for(k=0; k<n_ali; k++)
-        {
-            transform(t, u, &xtm[k][0], xrot);        
-            di=dist(xrot, &ytm[k][0]);
-            dis[k]=di;
-            tmscore1 += 1/(1+di/d02);
-        }
+        Kabsch(ctx.r1, ctx.r2, j, 1, &rms, ctx.t, ctx.u);
+        tmscore1=score_superposed_fast(xtm, ytm, n_ali,
+            tm_rotation(ctx.t, ctx.u), d02, score_cut_none, dis);
         
         //third iteration
         d002t=d002+1;
@@ -749,13 +699,9 @@ double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[]
             {            
                 if(dis[k]<=d002t)
                 {
-                    r1[j][0]=xtm[k][0];
-                    r1[j][1]=xtm[k][1];
-                    r1[j][2]=xtm[k][2];
+                    copy_coord(ctx.r1, j, xtm, k);
                     
-                    r2[j][0]=ytm[k][0];
-                    r2[j][1]=ytm[k][1];
-                    r2[j][2]=ytm[k][2];
+                    copy_coord(ctx.r2, j, ytm, k);
                                         
                     j++;
                 }
@@ -772,14 +718,9 @@ double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[]
         }
 
         //evaluate the score
-        Kabsch(r1, r2, j, 1, &rms, t, u);
-        tmscore2=0;
-        for(k=0; k<n_ali; k++)
-        {
-            transform(t, u, &xtm[k][0], xrot);
-            di=dist(xrot, &ytm[k][0]);
-            tmscore2 += 1/(1+di/d02);
-        }    
+        Kabsch(ctx.r1, ctx.r2, j, 1, &rms, ctx.t, ctx.u);
+        tmscore2=score_superposed_fast(xtm, ytm, n_ali,
+            tm_rotation(ctx.t, ctx.u), d02, score_cut_none, dis);
     }
     else
     {
@@ -791,10 +732,36 @@ double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[]
     if(tmscore1>=tmscore) tmscore=tmscore1;
     if(tmscore2>=tmscore) tmscore=tmscore2;
 
-    
+    arena_release(ctx.arena, mark);
+
     return tmscore; // no need to normalize this score because it will not be used for latter scoring
 }
 
+//compute the score of alignment invmap quickly in three iterations
+double get_score_fast(TMalign_ctx &ctx, const coord_array &x, const coord_array &y, int x_len, int y_len, int invmap[])
+{
+    int i, j, k;
+
+    k=0;
+    for(j=0; j<y_len; j++)
+    {
+        i=invmap[j];
+        if(i>=0)
+        {
+            copy_coord(ctx.xtm, k, x, i);
+            
+            copy_coord(ctx.ytm, k, y, j);
+            
+            k++;
+        }
+        else if(i!=-1)
+        {
+            PrintErrorAndQuit("Wrong map!\n");
+        }       
+    }
+    return get_score_fast(ctx, ctx.xtm, ctx.ytm, k);
+}
+
 
 //perform gapless threading to find the best initial alignment
 //input: x, y, x_len, y_len
@@ -802,8 +769,9 @@ double get_score_fast(double **x, double **y, int x_len, int y_len, int invmap[]
 //y2x0[j]=i means:
 //the jth element in y is aligned to the ith element in x if i>=0 
 //the jth element in y is aligned to a gap in x if i==-1
-double get_initial( double **x, 
-                    double **y, 
+double get_initial( TMalign_ctx &ctx,
+                    const coord_array &x, 
+                    const coord_array &y, 
                     int x_len,
                     int y_len, 
                     int *y2x
@@ -818,29 +786,20 @@ double get_initial( double **x,
     n1 = -y_len+min_ali; 
     n2 = x_len-min_ali;
 
-    int i, j, k, k_best;
+    int i, j, k, k_best, j0, j1;
     double tmscore, tmscore_max=-1;
 
     k_best=n1;
-    for(k=n1; k<=n2; k+=(fast_opt)?5:1)
+    for(k=n1; k<=n2; k+=(ctx.opt->fast_opt)?5:1)
     {
-        //get the map
-        for(j=0; j<y_len; j++)
-        {
-            i=j+k;
-            if(i>=0 && i<x_len)
-            {
-                y2x[j]=i;
-            }
-            else
-            {
-                y2x[j]=-1;
-            }
-        }
-        
+        //the map aligns y[j0..j1-1] to x[j0+k..j1-1+k], so its pairs are
+        //scored in place instead of being collected from y2x
+        j0=getmax(0, -k);
+        j1=getmin(y_len, x_len-k);
+
         //evaluate the map quickly in three iterations
         //this is not real tmscore, it is used to evaluate the goodness of the initial alignment
-        tmscore=get_score_fast(x, y, x_len, y_len, y2x); 
+        tmscore=get_score_fast(ctx, coord_slice(x, j0+k), coord_slice(y, j0), j1-j0); 
         if(tmscore>=tmscore_max)
         {
             tmscore_max=tmscore;
@@ -1027,7 +986,7 @@ int sec_str(double dis13, double dis14, double dis15, double dis24, double dis25
 
 
 //1->coil, 2->helix, 3->turn, 4->strand
-void make_sec(double **x, int len, int *sec)
+void make_sec(const coord_array &x, int len, int *sec)
 {
     int j1, j2, j3, j4, j5;
     double d13, d14, d15, d24, d25, d35;
@@ -1042,12 +1001,12 @@ void make_sec(double **x, int len, int *sec)
         
         if(j1>=0 && j5<len)
         {
-            d13=sqrt(dist(x[j1], x[j3]));
-            d14=sqrt(dist(x[j1], x[j4]));
-            d15=sqrt(dist(x[j1], x[j5]));
-            d24=sqrt(dist(x[j2], x[j4]));
-            d25=sqrt(dist(x[j2], x[j5]));
-            d35=sqrt(dist(x[j3], x[j5]));
+            d13=sqrt(dist(x, j1, x, j3));
+            d14=sqrt(dist(x, j1, x, j4));
+            d15=sqrt(dist(x, j1, x, j5));
+            d24=sqrt(dist(x, j2, x, j4));
+            d25=sqrt(dist(x, j2, x, j5));
+            d35=sqrt(dist(x, j3, x, j5));
             sec[i]=sec_str(d13, d14, d15, d24, d25, d35);            
         }    
     } 
@@ -1057,24 +1016,20 @@ void make_sec(double **x, int len, int *sec)
 
 
 //get initial alignment from secondary structure alignment
-//input: x, y, x_len, y_len
+//input: x_len, y_len
 //output: y2x stores the best alignment: e.g., 
 //y2x[j]=i means:
 //the jth element in y is aligned to the ith element in x if i>=0 
 //the jth element in y is aligned to a gap in x if i==-1
-void get_initial_ss(  double **x, 
-                      double **y, 
+void get_initial_ss(  TMalign_ctx &ctx,
                       int x_len,
                       int y_len, 
                       int *y2x
                       )
 {
-    //assign secondary structures
-    make_sec(x, x_len, secx);
-    make_sec(y, y_len, secy);
-
+    //secondary structures are assigned by load_PDB_allocate_memory
     double gap_open=-1.0;
-    NWDP_TM(secx, secy, x_len, y_len, gap_open, y2x);    
+    NWDP_TM(ctx, ctx.secx, ctx.secy, x_len, y_len, gap_open, y2x);    
 }
 
 
@@ -1085,24 +1040,25 @@ void get_initial_ss(  double **x,
 //y2x[j]=i means:
 //the jth element in y is aligned to the ith element in x if i>=0 
 //the jth element in y is aligned to a gap in x if i==-1
-bool get_initial5(double **x,
-    double **y,
+bool get_initial5(TMalign_ctx &ctx, const coord_array &x,
+    const coord_array &y,
     int x_len,
     int y_len,
     int *y2x
     )
 {
-    double GL, rmsd;
-    double t[3];
-    double u[3][3];
+    double GL;
+    double t[4][3];
+    double u[4][3][3]; // of the seeds of 4 j at a time
 
-    double d01 = d0 + 1.5;
-    if (d01 < D0_MIN) d01 = D0_MIN;
+    double d01 = ctx.d0 + 1.5;
+    if (d01 < ctx.D0_MIN) d01 = ctx.D0_MIN;
     double d02 = d01*d01;
 
     double GLmax = 0;
     int aL = getmin(x_len, y_len);
-    int *invmap = new int[y_len + 1];
+    size_t mark = arena_mark(ctx.arena);
+    int *invmap = arena_alloc<int>(ctx.arena, y_len + 1);
 
     // jump on sequence1-------------->
     int n_jump1 = 0;
@@ -1138,7 +1094,7 @@ bool get_initial5(double **x,
         n_frag[1] = aL / 2;
 
     // start superimpose search-------------->
-    if (fast_opt)
+    if (ctx.opt->fast_opt)
     {
         n_jump1*=5;
         n_jump2*=5;
@@ -1153,23 +1109,16 @@ bool get_initial5(double **x,
         {
             for (int j = 0; j<m2; j = j + n_jump2)
             {
-                for (int k = 0; k<n_frag[i_frag]; k++) //fragment in y
-                {
-                    r1[k][0] = x[k + i][0];
-                    r1[k][1] = x[k + i][1];
-                    r1[k][2] = x[k + i][2];
-
-                    r2[k][0] = y[k + j][0];
-                    r2[k][1] = y[k + j][1];
-                    r2[k][2] = y[k + j][2];
-                }
-
-                // superpose the two structures and rotate it
-                Kabsch(r1, r2, n_frag[i_frag], 1, &rmsd, t, u);
+                // superpose the fragments of the next 4 j at once
+                int l = (j / n_jump2) % 4;
+                if (l == 0)
+                    Kabsch_batch(x, i, y, j, n_jump2,
+                        getmin(4, (m2 - j + n_jump2 - 1) / n_jump2),
+                        n_frag[i_frag], t, u);
 
                 double gap_open = 0.0;
-                NWDP_TM(x, y, x_len, y_len, t, u, d02, gap_open, invmap);
-                GL = get_score_fast(x, y, x_len, y_len, invmap);
+                NWDP_TM(ctx, x, y, x_len, y_len, t[l], u[l], d02, gap_open, invmap);
+                GL = get_score_fast(ctx, x, y, x_len, y_len, invmap);
                 if (GL>GLmax)
                 {
                     GLmax = GL;
@@ -1183,140 +1132,56 @@ bool get_initial5(double **x,
         }
     }
 
-    delete[] invmap;
+    arena_release(ctx.arena, mark);
     return flag;
 }
 
-//with invmap(i) calculate score(i,j) using RMSD rotation
-void score_matrix_rmsd(  double **x, 
-                         double **y, 
+//get initial alignment from secondary structure and previous alignments
+//input: x, y, x_len, y_len
+//output: y2x stores the best alignment: e.g., 
+//y2x[j]=i means:
+//the jth element in y is aligned to the ith element in x if i>=0 
+//the jth element in y is aligned to a gap in x if i==-1
+void get_initial_ssplus( TMalign_ctx &ctx,
+                         const coord_array &x, 
+                         const coord_array &y, 
                          int x_len,
                          int y_len,
-                         int *y2x
+                         int *y2x0,
+                         int *y2x                        
                          )
 {
+    //superpose with the previous alignment y2x0
     double t[3], u[3][3];
-    double rmsd, dij;
-    double d01=d0+1.5;
-    if(d01 < D0_MIN) d01=D0_MIN;
-    double d02=d01*d01;
-
-    double xx[3];
-    int i, k=0;
-    for(int j=0; j<y_len; j++)
-    {
-        i=y2x[j];
-        if(i>=0)
-        {
-            r1[k][0]=x[i][0];  
-            r1[k][1]=x[i][1]; 
-            r1[k][2]=x[i][2];   
-            
-            r2[k][0]=y[j][0];  
-            r2[k][1]=y[j][1]; 
-            r2[k][2]=y[j][2];
-            
-            k++;
-        }
-    }
-    Kabsch(r1, r2, k, 1, &rmsd, t, u);
-    //do_rotation(x, xt, x_len, t, u);
-    
-    
-    for(int ii=0; ii<x_len; ii++)
-    {        
-        transform(t, u, &x[ii][0], xx);
-        for(int jj=0; jj<y_len; jj++)
-        {
-            //dij=dist(&xt[ii][0], &y[jj][0]);   
-            dij=dist(xx, &y[jj][0]); 
-            score[ii+1][jj+1] = 1.0/(1+dij/d02);
-            //    cout << ii+1 << " " << jj+1 << " " << score[ii+1][jj+1]<< endl;
-        }
-    }        
-}
-
-
-void score_matrix_rmsd_sec(  double **x, 
-                             double **y, 
-                             int x_len,
-                             int y_len,
-                             int *y2x
-                             )
-{
-    double t[3], u[3][3];
-    double rmsd, dij;
-    double d01=d0+1.5;
-    if(d01 < D0_MIN) d01=D0_MIN;
+    double rmsd;
+    double d01=ctx.d0+1.5;
+    if(d01 < ctx.D0_MIN) d01=ctx.D0_MIN;
     double d02=d01*d01;
 
-    double xx[3];
     int i, k=0;
     for(int j=0; j<y_len; j++)
     {
-        i=y2x[j];
+        i=y2x0[j];
         if(i>=0)
         {
-            r1[k][0]=x[i][0];  
-            r1[k][1]=x[i][1]; 
-            r1[k][2]=x[i][2];   
-            
-            r2[k][0]=y[j][0];  
-            r2[k][1]=y[j][1]; 
-            r2[k][2]=y[j][2];
-            
+            copy_coord(ctx.r1, k, x, i);
+            copy_coord(ctx.r2, k, y, j);
             k++;
         }
     }
-    Kabsch(r1, r2, k, 1, &rmsd, t, u);
+    Kabsch(ctx.r1, ctx.r2, k, 1, &rmsd, t, u);
 
-    
-    for(int ii=0; ii<x_len; ii++)
-    {        
-        transform(t, u, &x[ii][0], xx);
-        for(int jj=0; jj<y_len; jj++)
-        {
-            dij=dist(xx, &y[jj][0]); 
-            if(secx[ii]==secy[jj])
-            {
-                score[ii+1][jj+1] = 1.0/(1+dij/d02) + 0.5;
-            }
-            else
-            {
-                score[ii+1][jj+1] = 1.0/(1+dij/d02);
-            }        
-        }
-    }        
-}
-
-
-//get initial alignment from secondary structure and previous alignments
-//input: x, y, x_len, y_len
-//output: y2x stores the best alignment: e.g., 
-//y2x[j]=i means:
-//the jth element in y is aligned to the ith element in x if i>=0 
-//the jth element in y is aligned to a gap in x if i==-1
-void get_initial_ssplus( double **x, 
-                         double **y, 
-                         int x_len,
-                         int y_len,
-                         int *y2x0,
-                         int *y2x                        
-                         )
-{
-
-    //create score matrix for DP
-    score_matrix_rmsd_sec(x, y, x_len, y_len, y2x0);
-    
+    //DP on 1/(1+d^2/d02), plus 0.5 for the same secondary structure
     double gap_open=-1.0;
-    NWDP_TM(x_len, y_len, gap_open, y2x);
+    NWDP_TM(ctx, x, y, ctx.secx, ctx.secy, x_len, y_len, t, u, d02, gap_open, y2x);
 }
 
 
-void find_max_frag(double **x, int *resno, int len, int *start_max, int *end_max)
+//fra_min is the minimum fragment for search, 4, or 8 for -fast
+void find_max_frag(const coord_array &x, const int *resno, int len, double dcu0, int fra_min,
+    int *start_max, int *end_max)
 {
-    int r_min, fra_min=4;           //minimum fragment for search
-    if (fast_opt) fra_min=8;
+    int r_min;
     double d;
     int start;
     int Lfr_max=0, flag;
@@ -1325,7 +1190,7 @@ void find_max_frag(double **x, int *resno, int len, int *start_max, int *end_max
     if(r_min > fra_min) r_min=fra_min;
     
     int inc=0;
-    double dcu0_cut=dcu0*dcu0;;
+    double dcu0_cut=dcu0*dcu0;
     double dcu_cut=dcu0_cut;
 
     while(Lfr_max < r_min)
@@ -1335,7 +1200,7 @@ void find_max_frag(double **x, int *resno, int len, int *start_max, int *end_max
         start=0;
         for(int i=1; i<len; i++)
         {            
-            d = dist(x[i-1], x[i]);
+            d = dist(x, i-1, x, i);
             flag=0;
             if(dcu_cut>dcu0_cut)
             {
@@ -1396,31 +1261,27 @@ void find_max_frag(double **x, int *resno, int len, int *start_max, int *end_max
 //y2x0[j]=i means:
 //the jth element in y is aligned to the ith element in x if i>=0 
 //the jth element in y is aligned to a gap in x if i==-1
-double get_initial_fgt( double **x, 
-                        double **y, 
+double get_initial_fgt( TMalign_ctx &ctx,
+                        const coord_array &x, 
+                        const coord_array &y, 
                         int x_len,
                         int y_len, 
-                        int *xresno,
-                        int *yresno,
                         int *y2x
                         )
 {
     int fra_min=4;           //minimum fragment for search
-    if (fast_opt) fra_min=8;
+    if (ctx.opt->fast_opt) fra_min=8;
     int fra_min1=fra_min-1;  //cutoff for shift, save time
 
-    int xstart=0, ystart=0, xend=0, yend=0;
-
-    find_max_frag(x, xresno, x_len,  &xstart, &xend);
-    find_max_frag(y, yresno, y_len, &ystart, &yend);
+    //longest fragments, precomputed by load_PDB_allocate_memory
+    int xstart=ctx.xfrag[0], ystart=ctx.yfrag[0];
+    int xend=ctx.xfrag[1], yend=ctx.yfrag[1];
 
 
     int Lx = xend-xstart+1;
     int Ly = yend-ystart+1;
-    int *ifr, *y2x_;
+    int fr_start, i, j, k, j0, j1; //the fragment is fr_start..fr_start+L_fr-1
     int L_fr=getmin(Lx, Ly);
-    ifr= new int[L_fr];
-    y2x_= new int[y_len+1];
 
     //select what piece will be used (this may araise ansysmetry, but
     //only when L1=L2 and Lfr1=Lfr2 and L1 ne Lfr1
@@ -1428,17 +1289,11 @@ double get_initial_fgt( double **x,
 
     if(Lx<Ly || (Lx==Ly && x_len<=y_len))
     {        
-        for(int i=0; i<L_fr; i++)
-        {
-            ifr[i]=xstart+i;
-        }
+        fr_start=xstart;
     }
-    else if(Lx>Ly || (Lx==Ly && x_len>y_len))
+    else
     {        
-        for(int i=0; i<L_fr; i++)
-        {
-            ifr[i]=ystart+i;
-        }    
+        fr_start=ystart;
     }
 
     
@@ -1448,13 +1303,8 @@ double get_initial_fgt( double **x,
         int n1= (int)(L0*0.1); //my index starts from 0
         int n2= (int)(L0*0.89);
 
-        int j=0;
-        for(int i=n1; i<= n2; i++)
-        {
-            ifr[j]=ifr[i];
-            j++;
-        }
-        L_fr=j;
+        fr_start+=n1;
+        L_fr=n2-n1+1;
     }
 
 
@@ -1471,32 +1321,31 @@ double get_initial_fgt( double **x,
         n1 = -y_len+min_ali; 
         n2 = L1-min_ali;
 
-        int i, j, k;
-        for(k=n1; k<=n2; k+=(fast_opt)?3:1)
+        for(k=n1; k<=n2; k+=(ctx.opt->fast_opt)?3:1)
         {
-            //get the map
-            for(j=0; j<y_len; j++)
-            {
-                i=j+k;
-                if(i>=0 && i<L1)
-                {                
-                    y2x_[j]=ifr[i];
-                }
-                else
-                {
-                    y2x_[j]=-1;
-                }
-            }
+            //the map aligns y[j0..j1-1] to the fragment from j0+k, i.e.
+            //to x[fr_start+j0+k..], and is scored in place
+            j0=getmax(0, -k);
+            j1=getmin(y_len, L1-k);
 
             //evaluate the map quickly in three iterations
-            tmscore=get_score_fast(x, y, x_len, y_len, y2x_);
+            tmscore=get_score_fast(ctx, coord_slice(x, fr_start+j0+k),
+                coord_slice(y, j0), j1-j0);
 
             if(tmscore>=tmscore_max)
             {
                 tmscore_max=tmscore;
                 for(j=0; j<y_len; j++)
                 {
-                    y2x[j]=y2x_[j];
+                    i=j+k;
+                    if(i>=0 && i<L1)
+                    {                
+                        y2x[j]=fr_start+i;
+                    }
+                    else
+                    {
+                        y2x[j]=-1;
+                    }
                 }
             }
         }
@@ -1511,41 +1360,32 @@ double get_initial_fgt( double **x,
         n1 = -L2+min_ali; 
         n2 = x_len-min_ali;
 
-        int i, j, k;    
-
         for(k=n1; k<=n2; k++)
         {
-            //get the map
-            for(j=0; j<y_len; j++)
-            {
-                y2x_[j]=-1;
-            }
-
-            for(j=0; j<L2; j++)
-            {
-                i=j+k;
-                if(i>=0 && i<x_len)
-                {
-                    y2x_[ifr[j]]=i;
-                }
-            }
+            //the map aligns the fragment from j0, i.e. y[fr_start+j0..], to
+            //x[j0+k..j1-1+k], and is scored in place
+            j0=getmax(0, -k);
+            j1=getmin(L2, x_len-k);
         
             //evaluate the map quickly in three iterations
-            tmscore=get_score_fast(x, y, x_len, y_len, y2x_);
+            tmscore=get_score_fast(ctx, coord_slice(x, j0+k),
+                coord_slice(y, fr_start+j0), j1-j0);
             if(tmscore>=tmscore_max)
             {
                 tmscore_max=tmscore;
                 for(j=0; j<y_len; j++)
                 {
-                    y2x[j]=y2x_[j];
+                    y2x[j]=-1;
+                }
+                for(j=j0; j<j1; j++)
+                {
+                    y2x[fr_start+j]=j+k;
                 }
             }
         }
     }    
 
 
-    delete [] ifr;
-    delete [] y2x_;
     return tmscore_max;
 }
 
@@ -1557,8 +1397,9 @@ double get_initial_fgt( double **x,
 //input: initial rotation matrix t, u
 //       vectors x and y, d0
 //output: best alignment that maximizes the TMscore, will be stored in invmap
-double DP_iter( double **x,
-                double **y, 
+double DP_iter( TMalign_ctx &ctx,
+                const coord_array &x,
+                const coord_array &y, 
                 int x_len, 
                 int y_len, 
                 double t[3],
@@ -1572,7 +1413,8 @@ double DP_iter( double **x,
 {
     double gap_open[2]={-0.6, 0};
     double rmsd; 
-    int *invmap=new int[y_len+1];
+    size_t mark=arena_mark(ctx.arena);
+    int *invmap=arena_alloc<int>(ctx.arena, y_len+1);
     
     int iteration, i, j, k;
     double tmscore, tmscore_max, tmscore_old=0;    
@@ -1580,12 +1422,12 @@ double DP_iter( double **x,
     tmscore_max=-1;
 
     //double d01=d0+1.5;
-    double d02=d0*d0;
+    double d02=ctx.d0*ctx.d0;
     for(int g=g1; g<g2; g++)
     {
         for(iteration=0; iteration<iteration_max; iteration++)
         {           
-            NWDP_TM(x, y, x_len, y_len, t, u, d02, gap_open[g], invmap);
+            NWDP_TM(ctx, x, y, x_len, y_len, t, u, d02, gap_open[g], invmap);
             
             k=0;
             for(j=0; j<y_len; j++) 
@@ -1594,19 +1436,15 @@ double DP_iter( double **x,
 
                 if(i>=0) //aligned
                 {
-                    xtm[k][0]=x[i][0];
-                    xtm[k][1]=x[i][1];
-                    xtm[k][2]=x[i][2];
+                    copy_coord(ctx.xtm, k, x, i);
                     
-                    ytm[k][0]=y[j][0];
-                    ytm[k][1]=y[j][1];
-                    ytm[k][2]=y[j][2];
+                    copy_coord(ctx.ytm, k, y, j);
                     k++;
                 }
             }
 
             //tmscore=TMscore8_search(xtm, ytm, k, t, u, simplify_step, score_sum_method, &rmsd);
-            tmscore = TMscore8_search(xtm, ytm, k, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
+            tmscore = TMscore8_search(ctx, ctx.xtm, ctx.ytm, k, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
 
            
             if(tmscore>tmscore_max)
@@ -1631,12 +1469,12 @@ double DP_iter( double **x,
     }//for gapopen
     
     
-    delete []invmap;
+    arena_release(ctx.arena, mark);
     return tmscore_max;
 }
 
 
-void output_superpose(const char *xname, double t[3], double u[3][3], 
+void output_superpose(TMalign_ctx &ctx, const char *xname, double t[3], double u[3][3], 
     const int ter_opt=3)
 {
     ifstream fin(xname);
@@ -1674,7 +1512,7 @@ void output_superpose(const char *xname, double t[3], double u[3][3],
         PrintErrorAndQuit(message);
     }
 
-    ofstream fp(out_reg);
+    ofstream fp(ctx.opt->out_reg);
     fp<<buf.str();
     fp.close();
     buf.str(string()); // clear stream
@@ -1710,8 +1548,98 @@ void output_rotation_matrix(const char* fname_matrix,
         cout << "Open file to output rotation matrix fail.\n";
 }
 
+//print one direction of the final results: chain 1 is superposed onto chain 2
+void output_alignment(
+    TMalign_ctx &ctx,
+    const char *name1,
+    const char *name2,
+    int len1,
+    int len2,
+    double TM_1,     //TM-score normalized by length of chain 1
+    double TM_2,     //TM-score normalized by length of chain 2
+    double d0_1,
+    double d0_2,
+    double TM5,      //TM-score scaled by user assigned d0 (-d)
+    double Lnorm_5,
+    double rmsd,
+    double d0_out,
+    int n_ali8,
+    double seq_id,
+    const char *seq1A,
+    const char *seqM,
+    const char *seq2A,
+    const int outfmt_opt)
+{
+    if (outfmt_opt<=0)
+    {
+        sprintf_append(ctx.out, "\nName of Chain_1: %s (to be superimposed onto Chain_2)\n",
+            name1);
+        sprintf_append(ctx.out, "Name of Chain_2: %s\n", name2);
+        sprintf_append(ctx.out, "Length of Chain_1: %d residues\n", len1);
+        sprintf_append(ctx.out, "Length of Chain_2: %d residues\n\n", len2);
+
+        if (ctx.opt->i_opt || ctx.opt->I_opt)
+            sprintf_append(ctx.out, "User-specified initial alignment: TM/Lali/rmsd = %7.5lf, %4d, %6.3lf\n", ctx.TM_ali, ctx.L_ali, ctx.rmsd_ali);
+
+        sprintf_append(ctx.out, "Aligned length= %d, RMSD= %6.2f, Seq_ID=n_identical/n_aligned= %4.3f\n", n_ali8, rmsd, seq_id/( n_ali8+0.00000001));
+        sprintf_append(ctx.out, "TM-score= %6.5f (if normalized by length of Chain_1, i.e., LN=%d, d0=%.2f)\n", TM_1, len1, d0_1);
+        sprintf_append(ctx.out, "TM-score= %6.5f (if normalized by length of Chain_2, i.e., LN=%d, d0=%.2f)\n", TM_2, len2, d0_2);
+
+        if(ctx.opt->a_opt)
+            sprintf_append(ctx.out, "TM-score= %6.5f (if normalized by average length of two structures, i.e., LN= %.2f, d0= %.2f)\n", ctx.TM3, (len1+len2)*0.5, ctx.d0a);
+        if(ctx.opt->u_opt)
+            sprintf_append(ctx.out, "TM-score= %6.5f (if normalized by user-specified LN=%.2f and d0=%.2f)\n", ctx.TM4, ctx.opt->Lnorm_ass, ctx.d0u);
+        if(ctx.opt->d_opt)
+            sprintf_append(ctx.out, "TM-score= %6.5f (if scaled by user-specified d0= %.2f, and LN= %.2f)\n", TM5, ctx.opt->d0_scale, Lnorm_5);
+        sprintf_append(ctx.out, "(You should use TM-score normalized by length of the reference protein)\n");
+    
+        //output alignment
+        sprintf_append(ctx.out, "\n(\":\" denotes residue pairs of d < %4.1f Angstrom, ", d0_out);
+        sprintf_append(ctx.out, "\".\" denotes other aligned residues)\n");
+        sprintf_append(ctx.out, "%s\n", seq1A);
+        sprintf_append(ctx.out, "%s\n", seqM);
+        sprintf_append(ctx.out, "%s\n", seq2A);
+    }
+    else if (outfmt_opt==1)
+    {
+        sprintf_append(ctx.out, ">%s\tL=%d\td0=%.2f\tseqID=%.3f\tTM-score=%.5f\n",
+            name1, len1, d0_1, seq_id/len1, TM_1);
+        sprintf_append(ctx.out, "%s\n", seq1A);
+        sprintf_append(ctx.out, ">%s\tL=%d\td0=%.2f\tseqID=%.3f\tTM-score=%.5f\n",
+            name2, len2, d0_2, seq_id/len2, TM_2);
+        sprintf_append(ctx.out, "%s\n", seq2A);
+
+        sprintf_append(ctx.out, "# Lali=%d\tRMSD=%.2f\tseqID_ali=%.3f\n",
+            n_ali8, rmsd, seq_id/(n_ali8+0.00000001));
+
+        if (ctx.opt->i_opt || ctx.opt->I_opt)
+            sprintf_append(ctx.out, "# User-specified initial alignment: TM=%.5lf\tLali=%4d\trmsd=%.3lf\n", ctx.TM_ali, ctx.L_ali, ctx.rmsd_ali);
+
+        if(ctx.opt->a_opt)
+            sprintf_append(ctx.out, "# TM-score=%.5f (normalized by average length of two structures: L=%.2f\td0=%.2f)\n", ctx.TM3, (len1+len2)*0.5, ctx.d0a);
+
+        if(ctx.opt->u_opt)
+            sprintf_append(ctx.out, "# TM-score=%.5f (normalized by user-specified L=%.2f\td0=%.2f)\n", ctx.TM4, ctx.opt->Lnorm_ass, ctx.d0u);
+
+        if(ctx.opt->d_opt)
+            sprintf_append(ctx.out, "# TM-score=%.5f (scaled by user-specified d0=%.2f\tL=%.2f)\n", TM5, ctx.opt->d0_scale, Lnorm_5);
+
+        sprintf_append(ctx.out, "$$$$\n");
+    }
+    else if (outfmt_opt==2)
+    {
+        sprintf_append(ctx.out, "%s\t%s\t%.4f\t%.4f\t%.2f\t%.3f\t%4.3f\t%4.3f\t%d\t%d\t%d",
+            name1, name2,
+            TM_1, TM_2, rmsd,
+            seq_id/len1, seq_id/len2, seq_id/( n_ali8+0.00000001),
+            len1, len2, n_ali8);
+    }
+    ctx.out+='\n';
+}
+
 //output the final results
 void output_results(
+    TMalign_ctx &ctx,
     const char *xname,
     const char *yname,
     int x_len,
@@ -1740,11 +1668,12 @@ void output_results(
     double d;
     int ali_len=x_len+y_len; //maximum length of alignment
     char *seqM, *seqxA, *seqyA;
-    seqM=new char[ali_len];
-    seqxA=new char[ali_len];
-    seqyA=new char[ali_len];
+    size_t mark=arena_mark(ctx.arena);
+    seqM=arena_alloc<char>(ctx.arena, ali_len);
+    seqxA=arena_alloc<char>(ctx.arena, ali_len);
+    seqyA=arena_alloc<char>(ctx.arena, ali_len);
     
-    if (outfmt_opt<=0) do_rotation(xa, xt, x_len, t, u);
+    if (outfmt_opt<=0) do_rotation(ctx.xa, ctx.xt, x_len, t, u);
 
     seq_id=0;
     int kk=0, i_old=0, j_old=0;
@@ -1753,7 +1682,7 @@ void output_results(
         for(i=i_old; i<m1[k]; i++)
         {
             //align x to gap
-            seqxA[kk]=seqx[i];
+            seqxA[kk]=ctx.seqx[i];
             seqyA[kk]='-';
             seqM[kk]=' ';                    
             kk++;
@@ -1763,20 +1692,20 @@ void output_results(
         {
             //align y to gap
             seqxA[kk]='-';
-            seqyA[kk]=seqy[j];
+            seqyA[kk]=ctx.seqy[j];
             seqM[kk]=' ';
             kk++;
         }
 
-        seqxA[kk]=seqx[m1[k]];
-        seqyA[kk]=seqy[m2[k]];
+        seqxA[kk]=ctx.seqx[m1[k]];
+        seqyA[kk]=ctx.seqy[m2[k]];
         if(seqxA[kk]==seqyA[kk])
         {
             seq_id++;
         }
         if (outfmt_opt<=0)
         {
-            d=sqrt(dist(&xt[m1[k]][0], &ya[m2[k]][0]));
+            d=sqrt(dist(ctx.xt, m1[k], ctx.ya, m2[k]));
             if(d<d0_out) seqM[kk]=':';
             else         seqM[kk]='.';
         } 
@@ -1789,7 +1718,7 @@ void output_results(
     for(i=i_old; i<x_len; i++)
     {
         //align x to gap
-        seqxA[kk]=seqx[i];
+        seqxA[kk]=ctx.seqx[i];
         seqyA[kk]='-';
         seqM[kk]=' ';                    
         kk++;
@@ -1798,7 +1727,7 @@ void output_results(
     {
         //align y to gap
         seqxA[kk]='-';
-        seqyA[kk]=seqy[j];
+        seqyA[kk]=ctx.seqy[j];
         seqM[kk]=' ';
         kk++;
     }
@@ -1807,91 +1736,50 @@ void output_results(
     seqyA[kk]='\0';
     seqM[kk]='\0';
     
-    if (outfmt_opt<=0)
-    {
-        printf("\nName of Chain_1: %s (to be superimposed onto Chain_2)\n",
-            xname+dir1_opt.size());
-        printf("Name of Chain_2: %s\n", yname+dir2_opt.size());
-        printf("Length of Chain_1: %d residues\n", x_len);
-        printf("Length of Chain_2: %d residues\n\n", y_len);
-
-        if (i_opt || I_opt)
-            printf("User-specified initial alignment: TM/Lali/rmsd = %7.5lf, %4d, %6.3lf\n", TM_ali, L_ali, rmsd_ali);
-
-        printf("Aligned length= %d, RMSD= %6.2f, Seq_ID=n_identical/n_aligned= %4.3f\n", n_ali8, rmsd, seq_id/( n_ali8+0.00000001));
-        printf("TM-score= %6.5f (if normalized by length of Chain_1, i.e., LN=%d, d0=%.2f)\n", TM2, x_len, d0B);
-        printf("TM-score= %6.5f (if normalized by length of Chain_2, i.e., LN=%d, d0=%.2f)\n", TM1, y_len, d0A);
-
-        if(a_opt)
-            printf("TM-score= %6.5f (if normalized by average length of two structures, i.e., LN= %.2f, d0= %.2f)\n", TM3, (x_len+y_len)*0.5, d0a);
-        if(u_opt)
-            printf("TM-score= %6.5f (if normalized by user-specified LN=%.2f and d0=%.2f)\n", TM4, Lnorm_ass, d0u);
-        if(d_opt)
-            printf("TM-score= %6.5f (if scaled by user-specified d0= %.2f, and LN= %.2f)\n", TM5, d0_scale, Lnorm_0);
-        printf("(You should use TM-score normalized by length of the reference protein)\n");
-    
-        //output alignment
-        printf("\n(\":\" denotes residue pairs of d < %4.1f Angstrom, ", d0_out);
-        printf("\".\" denotes other aligned residues)\n");
-        printf("%s\n", seqxA);
-        printf("%s\n", seqM);
-        printf("%s\n", seqyA);
-    }
-    else if (outfmt_opt==1)
+    ctx.TM_1=TM2;
+    ctx.TM_2=TM1;
+    ctx.rmsd0=rmsd;
+    ctx.n_ali8=n_ali8;
+    ctx.seq_id=seq_id;
+    for (i=0;i<3;i++)
     {
-        printf(">%s\tL=%d\td0=%.2f\tseqID=%.3f\tTM-score=%.5f\n",
-            xname+dir1_opt.size(), x_len, d0B, seq_id/x_len, TM2);
-        printf("%s\n", seqxA);
-        printf(">%s\tL=%d\td0=%.2f\tseqID=%.3f\tTM-score=%.5f\n",
-            yname+dir2_opt.size(), y_len, d0A, seq_id/y_len, TM1);
-        printf("%s\n", seqyA);
-
-        printf("# Lali=%d\tRMSD=%.2f\tseqID_ali=%.3f\n",
-            n_ali8, rmsd, seq_id/(n_ali8+0.00000001));
-
-        if (i_opt || I_opt)
-            printf("# User-specified initial alignment: TM=%.5lf\tLali=%4d\trmsd=%.3lf\n", TM_ali, L_ali, rmsd_ali);
-
-        if(a_opt)
-            printf("# TM-score=%.5f (normalized by average length of two structures: L=%.2f\td0=%.2f)\n", TM3, (x_len+y_len)*0.5, d0a);
-
-        if(u_opt)
-            printf("# TM-score=%.5f (normalized by user-specified L=%.2f\td0=%.2f)\n", TM4, Lnorm_ass, d0u);
-
-        if(d_opt)
-            printf("# TM-score=%.5f (scaled by user-specified d0=%.2f\tL=%.2f)\n", TM5, d0_scale, Lnorm_0);
-
-        printf("$$$$\n");
+        ctx.t0[i]=t[i];
+        for (j=0;j<3;j++) ctx.u0[i][j]=u[i][j];
     }
-    else if (outfmt_opt==2)
+    ctx.seqxA=seqxA;
+    ctx.seqM=seqM;
+    ctx.seqyA=seqyA;
+
+    output_alignment(ctx, xname+dir1_opt.size(), yname+dir2_opt.size(),
+        x_len, y_len, TM2, TM1, ctx.d0B, ctx.d0A, ctx.TM5, Lnorm_0,
+        rmsd, d0_out, n_ali8, seq_id, seqxA, seqM, seqyA, outfmt_opt);
+    if (ctx.opt->all_opt)
     {
-        printf("%s\t%s\t%.4f\t%.4f\t%.2f\t%.3f\t%4.3f\t%4.3f\t%d\t%d\t%d",
-            xname+dir1_opt.size(), yname+dir2_opt.size(),
-            TM2, TM1, rmsd,
-            seq_id/x_len, seq_id/y_len, seq_id/( n_ali8+0.00000001),
-            x_len, y_len, n_ali8);
+        //chain 2 onto chain 1 from the same alignment. -a and -u lengths
+        //are symmetric, otherwise the -d score is normalized by chain 1
+        double Lnorm_5=(ctx.opt->a_opt || ctx.opt->u_opt)?Lnorm_0:x_len;
+        output_alignment(ctx, yname+dir2_opt.size(), xname+dir1_opt.size(),
+            y_len, x_len, TM1, TM2, ctx.d0A, ctx.d0B, ctx.TM5_rev, Lnorm_5,
+            rmsd, d0_out, n_ali8, seq_id, seqyA, seqM, seqxA, outfmt_opt);
     }
-    cout << endl;
 
-    if (m_opt) output_rotation_matrix(fname_matrix, t, u);
-    if (o_opt) output_superpose(xname, t, u, ter_opt);
+    if (ctx.opt->m_opt) output_rotation_matrix(fname_matrix, t, u);
+    if (ctx.opt->o_opt) output_superpose(ctx, xname, t, u, ter_opt);
 
-    delete [] seqM;
-    delete [] seqxA;
-    delete [] seqyA;
+    arena_release(ctx.arena, mark);
 }
 
-double standard_TMscore(double **x, double **y, int x_len, int y_len, int invmap[], int& L_ali, double& RMSD )
+double standard_TMscore(TMalign_ctx &ctx, const coord_array &x, const coord_array &y, int x_len, int y_len, int invmap[], int& L_ali, double& RMSD )
 {
-    D0_MIN = 0.5;
-    Lnorm = y_len;
-    if (Lnorm > 21)
-        d0 = (1.24*pow((Lnorm*1.0 - 15), 1.0 / 3) - 1.8);
+    ctx.D0_MIN = 0.5;
+    ctx.Lnorm = y_len;
+    if (ctx.Lnorm > 21)
+        ctx.d0 = (1.24*pow((ctx.Lnorm*1.0 - 15), 1.0 / 3) - 1.8);
     else
-        d0 = D0_MIN;
-    if (d0 < D0_MIN)
-        d0 = D0_MIN;
-    double d0_input = d0;// Scaled by seq_min
+        ctx.d0 = ctx.D0_MIN;
+    if (ctx.d0 < ctx.D0_MIN)
+        ctx.d0 = ctx.D0_MIN;
+    double d0_input = ctx.d0;// Scaled by seq_min
 
     double tmscore;// collected alined residues from invmap
     int n_al = 0;
@@ -1901,21 +1789,13 @@ double standard_TMscore(double **x, double **y, int x_len, int y_len, int invmap
         i = invmap[j];
         if (i >= 0)
         {
-            xtm[n_al][0] = x[i][0];
-            xtm[n_al][1] = x[i][1];
-            xtm[n_al][2] = x[i][2];
+            copy_coord(ctx.xtm, n_al, x, i);
 
-            ytm[n_al][0] = y[j][0];
-            ytm[n_al][1] = y[j][1];
-            ytm[n_al][2] = y[j][2];
+            copy_coord(ctx.ytm, n_al, y, j);
 
-            r1[n_al][0] = x[i][0];
-            r1[n_al][1] = x[i][1];
-            r1[n_al][2] = x[i][2];
+            copy_coord(ctx.r1, n_al, x, i);
 
-            r2[n_al][0] = y[j][0];
-            r2[n_al][1] = y[j][1];
-            r2[n_al][2] = y[j][2];
+            copy_coord(ctx.r2, n_al, y, j);
 
             n_al++;
         }
@@ -1926,44 +1806,45 @@ double standard_TMscore(double **x, double **y, int x_len, int y_len, int invmap
     }
     L_ali = n_al;
 
-    Kabsch(r1, r2, n_al, 0, &RMSD, t, u);
+    Kabsch(ctx.r1, ctx.r2, n_al, 0, &RMSD, ctx.t, ctx.u);
     RMSD = sqrt( RMSD/(1.0*n_al) );
     
     int temp_simplify_step = 1;
     int temp_score_sum_method = 0;
-    d0_search = d0_input;
+    ctx.d0_search = d0_input;
     double rms = 0.0;
-    tmscore = TMscore8_search_standard(xtm, ytm, n_al, t, u, temp_simplify_step, temp_score_sum_method, &rms, d0_input);
-    tmscore = tmscore * n_al / (1.0*Lnorm);
+    tmscore = TMscore8_search_standard(ctx, ctx.xtm, ctx.ytm, n_al, ctx.t, ctx.u, temp_simplify_step, temp_score_sum_method, &rms, d0_input);
+    tmscore = tmscore * n_al / (1.0*ctx.Lnorm);
 
     return tmscore;
 }
 
 /* entry function for TMalign */
-int TMalign_main(const char *xname, const char *yname,
+int TMalign_main(TMalign_ctx &ctx, const char *xname, const char *yname,
     const char *fname_matrix, const int ter_opt,
     const string dir1_opt, const string dir2_opt, const int outfmt_opt)
 {
     /***********************/
     /*    parameter set    */
     /***********************/
-    parameter_set4search(xlen, ylen);          //please set parameters in the function
+    parameter_set4search(ctx, ctx.xlen, ctx.ylen);          //please set parameters in the function
     int simplify_step     = 40;               //for similified search engine
     int score_sum_method  = 8;                //for scoring method, whether only sum over pairs with dis<score_d8
 
     int i;
-    int *invmap0          = new int[ylen+1];
-    int *invmap           = new int[ylen+1];
+    size_t mark           = arena_mark(ctx.arena);
+    int *invmap0          = arena_alloc<int>(ctx.arena, ctx.ylen+1);
+    int *invmap           = arena_alloc<int>(ctx.arena, ctx.ylen+1);
     double TM, TMmax=-1;
-    for(i=0; i<ylen; i++)
+    for(i=0; i<ctx.ylen; i++)
     {
         invmap0[i]=-1;
     }
 
 
     double ddcc=0.4;
-    if(Lnorm <= 40) ddcc=0.1;   //Lnorm was setted in parameter_set4search
-    double local_d0_search = d0_search;
+    if(ctx.Lnorm <= 40) ddcc=0.1;   //Lnorm was setted in parameter_set4search
+    double local_d0_search = ctx.d0_search;
 
     //************************************************//
     //    get initial alignment from user's input:    //
@@ -1971,28 +1852,28 @@ int TMalign_main(const char *xname, const char *yname,
     //************************************************//
     char dest[1000];
     bool bAlignStick = false;
-    if (I_opt)// if input has set parameter for "-I"
+    if (ctx.opt->I_opt)// if input has set parameter for "-I"
     {
-        for (int j = 1; j < ylen; j++)// Set aligned position to be "-1"
+        for (int j = 1; j < ctx.ylen; j++)// Set aligned position to be "-1"
             invmap[j] = -1;
 
         int i1 = -1;// in C version, index starts from zero, not from one
         int i2 = -1;
-        int L1 = strlen(sequence[0]);
-        int L2 = strlen(sequence[1]);
+        int L1 = strlen(ctx.opt->sequence[0]);
+        int L2 = strlen(ctx.opt->sequence[1]);
         int L = min(L1, L2);// Get positions for aligned residues
         for (int kk1 = 0; kk1 < L; kk1++)
         {
-            if (sequence[0][kk1] != '-')
+            if (ctx.opt->sequence[0][kk1] != '-')
                 i1++;
-            if (sequence[1][kk1] != '-')
+            if (ctx.opt->sequence[1][kk1] != '-')
             {
                 i2++;
-                if (i2 >= ylen || i1 >= xlen)
+                if (i2 >= ctx.ylen || i1 >= ctx.xlen)
                     kk1 = L;
                 else
                 {
-                    if (sequence[0][kk1] != '-')
+                    if (ctx.opt->sequence[0][kk1] != '-')
                     {
                         invmap[i2] = i1;
                     }
@@ -2001,18 +1882,18 @@ int TMalign_main(const char *xname, const char *yname,
         }
 
         //--------------- 2. Align proteins from original alignment
-        double prevD0_MIN = D0_MIN;// stored for later use
-        int prevLnorm = Lnorm;
-        double prevd0 = d0;
-        TM_ali = standard_TMscore(xa, ya, xlen, ylen, invmap, L_ali, rmsd_ali);
-        D0_MIN = prevD0_MIN;
-        Lnorm = prevLnorm;
-        d0 = prevd0;
-        TM = detailed_search_standard(xa, ya, xlen, ylen, invmap, t, u, 40, 8, local_d0_search, true);
+        double prevD0_MIN = ctx.D0_MIN;// stored for later use
+        int prevLnorm = ctx.Lnorm;
+        double prevd0 = ctx.d0;
+        ctx.TM_ali = standard_TMscore(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.L_ali, ctx.rmsd_ali);
+        ctx.D0_MIN = prevD0_MIN;
+        ctx.Lnorm = prevLnorm;
+        ctx.d0 = prevd0;
+        TM = detailed_search_standard(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.t, ctx.u, 40, 8, local_d0_search, true);
         if (TM > TMmax)
         {
             TMmax = TM;
-            for (i = 0; i<ylen; i++)
+            for (i = 0; i<ctx.ylen; i++)
                 invmap0[i] = invmap[i];
         }
         bAlignStick = true;
@@ -2023,19 +1904,19 @@ int TMalign_main(const char *xname, const char *yname,
     /******************************************************/
     if (!bAlignStick)
     {
-        get_initial(xa, ya, xlen, ylen, invmap0);
+        get_initial(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap0);
         //find the max TMscore for this initial alignment with the simplified search_engin
-        TM = detailed_search(xa, ya, xlen, ylen, invmap0, t, u, simplify_step, score_sum_method, local_d0_search);
+        TM = detailed_search(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap0, ctx.t, ctx.u, simplify_step, score_sum_method, local_d0_search);
         if (TM>TMmax)
         {
             TMmax = TM;
         }
         //run dynamic programing iteratively to find the best alignment
-        TM = DP_iter(xa, ya, xlen, ylen, t, u, invmap, 0, 2, (fast_opt)?2:30, local_d0_search);
+        TM = DP_iter(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, ctx.t, ctx.u, invmap, 0, 2, (ctx.opt->fast_opt)?2:30, local_d0_search);
         if (TM>TMmax)
         {
             TMmax = TM;
-            for (int i = 0; i<ylen; i++)
+            for (int i = 0; i<ctx.ylen; i++)
             {
                 invmap0[i] = invmap[i];
             }
@@ -2045,23 +1926,23 @@ int TMalign_main(const char *xname, const char *yname,
         /************************************************************/
         /*    get initial alignment based on secondary structure    */
         /************************************************************/
-        get_initial_ss(xa, ya, xlen, ylen, invmap);
-        TM = detailed_search(xa, ya, xlen, ylen, invmap, t, u, simplify_step, score_sum_method, local_d0_search);
+        get_initial_ss(ctx, ctx.xlen, ctx.ylen, invmap);
+        TM = detailed_search(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.t, ctx.u, simplify_step, score_sum_method, local_d0_search);
         if (TM>TMmax)
         {
             TMmax = TM;
-            for (int i = 0; i<ylen; i++)
+            for (int i = 0; i<ctx.ylen; i++)
             {
                 invmap0[i] = invmap[i];
             }
         }
         if (TM > TMmax*0.2)
         {
-            TM = DP_iter(xa, ya, xlen, ylen, t, u, invmap, 0, 2, (fast_opt)?2:30, local_d0_search);
+            TM = DP_iter(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, ctx.t, ctx.u, invmap, 0, 2, (ctx.opt->fast_opt)?2:30, local_d0_search);
             if (TM>TMmax)
             {
                 TMmax = TM;
-                for (int i = 0; i<ylen; i++)
+                for (int i = 0; i<ctx.ylen; i++)
                 {
                     invmap0[i] = invmap[i];
                 }
@@ -2073,24 +1954,24 @@ int TMalign_main(const char *xname, const char *yname,
         /*    get initial alignment based on local superposition    */
         /************************************************************/
         //=initial5 in original TM-align
-        if (get_initial5(xa, ya, xlen, ylen, invmap))
+        if (get_initial5(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap))
         {
-            TM = detailed_search(xa, ya, xlen, ylen, invmap, t, u, simplify_step, score_sum_method, local_d0_search);
+            TM = detailed_search(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.t, ctx.u, simplify_step, score_sum_method, local_d0_search);
             if (TM>TMmax)
             {
                 TMmax = TM;
-                for (int i = 0; i<ylen; i++)
+                for (int i = 0; i<ctx.ylen; i++)
                 {
                     invmap0[i] = invmap[i];
                 }
             }
             if (TM > TMmax*ddcc)
             {
-                TM = DP_iter(xa, ya, xlen, ylen, t, u, invmap, 0, 2, 2, local_d0_search);
+                TM = DP_iter(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, ctx.t, ctx.u, invmap, 0, 2, 2, local_d0_search);
                 if (TM>TMmax)
                 {
                     TMmax = TM;
-                    for (int i = 0; i<ylen; i++)
+                    for (int i = 0; i<ctx.ylen; i++)
                     {
                         invmap0[i] = invmap[i];
                     }
@@ -2099,7 +1980,7 @@ int TMalign_main(const char *xname, const char *yname,
         }
         else
         {
-            cout << "\n\nWarning: initial alignment from local superposition fail!\n\n" << endl;
+            ctx.out+="\n\nWarning: initial alignment from local superposition fail!\n\n\n";
         }
 
 
@@ -2107,23 +1988,23 @@ int TMalign_main(const char *xname, const char *yname,
         /*    get initial alignment based on previous alignment+secondary structure    */
         /*******************************************************************************/
         //=initial3 in original TM-align
-        get_initial_ssplus(xa, ya, xlen, ylen, invmap0, invmap);
-        TM = detailed_search(xa, ya, xlen, ylen, invmap, t, u, simplify_step, score_sum_method, local_d0_search);
+        get_initial_ssplus(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap0, invmap);
+        TM = detailed_search(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.t, ctx.u, simplify_step, score_sum_method, local_d0_search);
         if (TM>TMmax)
         {
             TMmax = TM;
-            for (i = 0; i<ylen; i++)
+            for (i = 0; i<ctx.ylen; i++)
             {
                 invmap0[i] = invmap[i];
             }
         }
         if (TM > TMmax*ddcc)
         {
-            TM = DP_iter(xa, ya, xlen, ylen, t, u, invmap, 0, 2, (fast_opt)?2:30, local_d0_search);
+            TM = DP_iter(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, ctx.t, ctx.u, invmap, 0, 2, (ctx.opt->fast_opt)?2:30, local_d0_search);
             if (TM>TMmax)
             {
                 TMmax = TM;
-                for (i = 0; i<ylen; i++)
+                for (i = 0; i<ctx.ylen; i++)
                 {
                     invmap0[i] = invmap[i];
                 }
@@ -2135,23 +2016,23 @@ int TMalign_main(const char *xname, const char *yname,
         /*    get initial alignment based on fragment gapless threading    */
         /*******************************************************************/
         //=initial4 in original TM-align
-        get_initial_fgt(xa, ya, xlen, ylen, xresno, yresno, invmap);
-        TM = detailed_search(xa, ya, xlen, ylen, invmap, t, u, simplify_step, score_sum_method, local_d0_search);
+        get_initial_fgt(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap);
+        TM = detailed_search(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.t, ctx.u, simplify_step, score_sum_method, local_d0_search);
         if (TM>TMmax)
         {
             TMmax = TM;
-            for (i = 0; i<ylen; i++)
+            for (i = 0; i<ctx.ylen; i++)
             {
                 invmap0[i] = invmap[i];
             }
         }
         if (TM > TMmax*ddcc)
         {
-            TM = DP_iter(xa, ya, xlen, ylen, t, u, invmap, 1, 2, 2, local_d0_search);
+            TM = DP_iter(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, ctx.t, ctx.u, invmap, 1, 2, 2, local_d0_search);
             if (TM>TMmax)
             {
                 TMmax = TM;
-                for (i = 0; i<ylen; i++)
+                for (i = 0; i<ctx.ylen; i++)
                 {
                     invmap0[i] = invmap[i];
                 }
@@ -2162,28 +2043,28 @@ int TMalign_main(const char *xname, const char *yname,
         //************************************************//
         //    get initial alignment from user's input:    //
         //************************************************//
-        if (i_opt)// if input has set parameter for "-i"
+        if (ctx.opt->i_opt)// if input has set parameter for "-i"
         {
-            for (int j = 0; j < ylen; j++)// Set aligned position to be "-1"
+            for (int j = 0; j < ctx.ylen; j++)// Set aligned position to be "-1"
                 invmap[j] = -1;
 
             int i1 = -1;// in C version, index starts from zero, not from one
             int i2 = -1;
-            int L1 = strlen(sequence[0]);
-            int L2 = strlen(sequence[1]);
+            int L1 = strlen(ctx.opt->sequence[0]);
+            int L2 = strlen(ctx.opt->sequence[1]);
             int L = min(L1, L2);// Get positions for aligned residues
             for (int kk1 = 0; kk1 < L; kk1++)
             {
-                if (sequence[0][kk1] != '-')
+                if (ctx.opt->sequence[0][kk1] != '-')
                     i1++;
-                if (sequence[1][kk1] != '-')
+                if (ctx.opt->sequence[1][kk1] != '-')
                 {
                     i2++;
-                    if (i2 >= ylen || i1 >= xlen)
+                    if (i2 >= ctx.ylen || i1 >= ctx.xlen)
                         kk1 = L;
                     else
                     {
-                        if (sequence[0][kk1] != '-')
+                        if (ctx.opt->sequence[0][kk1] != '-')
                         {
                             invmap[i2] = i1;
                         }
@@ -2192,26 +2073,26 @@ int TMalign_main(const char *xname, const char *yname,
             }
 
             //--------------- 2. Align proteins from original alignment
-            double prevD0_MIN = D0_MIN;// stored for later use
-            int prevLnorm = Lnorm;
-            double prevd0 = d0;
-            TM_ali = standard_TMscore(xa, ya, xlen, ylen, invmap, L_ali, rmsd_ali);
-            D0_MIN = prevD0_MIN;
-            Lnorm = prevLnorm;
-            d0 = prevd0;
-
-            TM = detailed_search_standard(xa, ya, xlen, ylen, invmap, t, u, 40, 8, local_d0_search, true);
+            double prevD0_MIN = ctx.D0_MIN;// stored for later use
+            int prevLnorm = ctx.Lnorm;
+            double prevd0 = ctx.d0;
+            ctx.TM_ali = standard_TMscore(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.L_ali, ctx.rmsd_ali);
+            ctx.D0_MIN = prevD0_MIN;
+            ctx.Lnorm = prevLnorm;
+            ctx.d0 = prevd0;
+
+            TM = detailed_search_standard(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap, ctx.t, ctx.u, 40, 8, local_d0_search, true);
             if (TM > TMmax)
             {
                 TMmax = TM;
-                for (i = 0; i<ylen; i++)
+                for (i = 0; i<ctx.ylen; i++)
                     invmap0[i] = invmap[i];
             }
-            TM = DP_iter(xa, ya, xlen, ylen, t, u, invmap, 0, 2, (fast_opt)?2:30, local_d0_search);// Different from get_initial, get_initial_ss and get_initial_ssplus
+            TM = DP_iter(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, ctx.t, ctx.u, invmap, 0, 2, (ctx.opt->fast_opt)?2:30, local_d0_search);// Different from get_initial, get_initial_ss and get_initial_ssplus
             if (TM>TMmax)
             {
                 TMmax = TM;
-                for (i = 0; i<ylen; i++)
+                for (i = 0; i<ctx.ylen; i++)
                 {
                     invmap0[i] = invmap[i];
                 }
@@ -2226,7 +2107,7 @@ int TMalign_main(const char *xname, const char *yname,
     //*******************************************************************//
     //check if the initial alignment is generated approately
     bool flag=false;
-    for(i=0; i<ylen; i++)
+    for(i=0; i<ctx.ylen; i++)
     {
         if(invmap0[i]>=0)
         {
@@ -2236,8 +2117,9 @@ int TMalign_main(const char *xname, const char *yname,
     }
     if(!flag)
     {
-        cout << "There is no alignment between the two proteins!" << endl;
-        cout << "Program stop with no result!" << endl;
+        ctx.out+="There is no alignment between the two proteins!\n";
+        ctx.out+="Program stop with no result!\n";
+        arena_release(ctx.arena, mark);
         return 1;
     }
 
@@ -2248,9 +2130,9 @@ int TMalign_main(const char *xname, const char *yname,
     //run detailed TMscore search engine for the best alignment, and
     //extract the best rotation matrix (t, u) for the best alginment
     simplify_step=1;
-    if (fast_opt) simplify_step=40;
+    if (ctx.opt->fast_opt) simplify_step=40;
     score_sum_method=8;
-    TM = detailed_search_standard(xa, ya, xlen, ylen, invmap0, t, u, simplify_step, score_sum_method, local_d0_search, false);
+    TM = detailed_search_standard(ctx, ctx.xa, ctx.ya, ctx.xlen, ctx.ylen, invmap0, ctx.t, ctx.u, simplify_step, score_sum_method, local_d0_search, false);
 
 
     //select pairs with dis<d8 for final TMscore computation and output alignment
@@ -2258,36 +2140,28 @@ int TMalign_main(const char *xname, const char *yname,
     int n_ali=0;
     int *m1, *m2;
     double d;
-    m1=new int[xlen]; //alignd index in x
-    m2=new int[ylen]; //alignd index in y
-    do_rotation(xa, xt, xlen, t, u);
+    m1=arena_alloc<int>(ctx.arena, ctx.xlen); //alignd index in x
+    m2=arena_alloc<int>(ctx.arena, ctx.ylen); //alignd index in y
+    do_rotation(ctx.xa, ctx.xt, ctx.xlen, ctx.t, ctx.u);
     k=0;
-    for(int j=0; j<ylen; j++)
+    for(int j=0; j<ctx.ylen; j++)
     {
         i=invmap0[j];
         if(i>=0)//aligned
         {
             n_ali++;
-            d=sqrt(dist(&xt[i][0], &ya[j][0]));
-            if (d <= score_d8 || (I_opt == true))
+            d=sqrt(dist(ctx.xt, i, ctx.ya, j));
+            if (d <= ctx.score_d8 || (ctx.opt->I_opt == true))
             {
                 m1[k]=i;
                 m2[k]=j;
 
-                xtm[k][0]=xa[i][0];
-                xtm[k][1]=xa[i][1];
-                xtm[k][2]=xa[i][2];
+                copy_coord(ctx.xtm, k, ctx.xa, i);
 
-                ytm[k][0]=ya[j][0];
-                ytm[k][1]=ya[j][1];
-                ytm[k][2]=ya[j][2];
+                copy_coord(ctx.ytm, k, ctx.ya, j);
 
-                r1[k][0] = xt[i][0];
-                r1[k][1] = xt[i][1];
-                r1[k][2] = xt[i][2];
-                r2[k][0] = ya[j][0];
-                r2[k][1] = ya[j][1];
-                r2[k][2] = ya[j][2];
+                copy_coord(ctx.r1, k, ctx.xt, i);
+                copy_coord(ctx.r2, k, ctx.ya, j);
 
                 k++;
             }
@@ -2296,7 +2170,7 @@ int TMalign_main(const char *xname, const char *yname,
     n_ali8=k;
 
     double rmsd0 = 0.0;
-    Kabsch(r1, r2, n_ali8, 0, &rmsd0, t, u);// rmsd0 is used for final output, only recalculate rmsd0, not t & u
+    Kabsch(ctx.r1, ctx.r2, n_ali8, 0, &rmsd0, ctx.t, ctx.u);// rmsd0 is used for final output, only recalculate rmsd0, not t & u
     rmsd0 = sqrt(rmsd0 / n_ali8);
 
 
@@ -2312,70 +2186,81 @@ int TMalign_main(const char *xname, const char *yname,
     score_sum_method=0;
 
     double d0_0, TM_0;
-    double Lnorm_0=ylen;
+    double Lnorm_0=ctx.ylen;
 
 
     //normalized by length of structure A
-    parameter_set4final(Lnorm_0);
-    d0A=d0;
-    d0_0=d0A;
-    local_d0_search = d0_search;
-    TM1 = TMscore8_search(xtm, ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
+    parameter_set4final(ctx, Lnorm_0);
+    ctx.d0A=ctx.d0;
+    d0_0=ctx.d0A;
+    local_d0_search = ctx.d0_search;
+    TM1 = TMscore8_search(ctx, ctx.xtm, ctx.ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
     TM_0 = TM1;
 
     //normalized by length of structure B
-    parameter_set4final(xlen+0.0);
-    d0B=d0;
-    local_d0_search = d0_search;
-    TM2 = TMscore8_search(xtm, ytm, n_ali8, t, u, simplify_step, score_sum_method, &rmsd, local_d0_search);
+    parameter_set4final(ctx, ctx.xlen+0.0);
+    ctx.d0B=ctx.d0;
+    local_d0_search = ctx.d0_search;
+    TM2 = TMscore8_search(ctx, ctx.xtm, ctx.ytm, n_ali8, ctx.t, ctx.u, simplify_step, score_sum_method, &rmsd, local_d0_search);
 
 
-    if(a_opt)
+    if(ctx.opt->a_opt)
     {
         //normalized by average length of structures A, B
-        Lnorm_0=(xlen+ylen)*0.5;
-        parameter_set4final(Lnorm_0);
-        d0a=d0;
-        d0_0=d0a;
-        local_d0_search = d0_search;
-
-        TM3 = TMscore8_search(xtm, ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
-        TM_0=TM3;
+        Lnorm_0=(ctx.xlen+ctx.ylen)*0.5;
+        parameter_set4final(ctx, Lnorm_0);
+        ctx.d0a=ctx.d0;
+        d0_0=ctx.d0a;
+        local_d0_search = ctx.d0_search;
+
+        ctx.TM3 = TMscore8_search(ctx, ctx.xtm, ctx.ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
+        TM_0=ctx.TM3;
     }
-    if(u_opt)
+    if(ctx.opt->u_opt)
     {
         //normalized by user assigned length
-        parameter_set4final(Lnorm_ass);
-        d0u=d0;
-        d0_0=d0u;
-        Lnorm_0=Lnorm_ass;
-        local_d0_search = d0_search;
-        TM4 = TMscore8_search(xtm, ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
-        TM_0=TM4;
+        parameter_set4final(ctx, ctx.opt->Lnorm_ass);
+        ctx.d0u=ctx.d0;
+        d0_0=ctx.d0u;
+        Lnorm_0=ctx.opt->Lnorm_ass;
+        local_d0_search = ctx.d0_search;
+        ctx.TM4 = TMscore8_search(ctx, ctx.xtm, ctx.ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
+        TM_0=ctx.TM4;
     }
-    if(d_opt)
+    if(ctx.opt->d_opt)
     {
         //scaled by user assigned d0
-        parameter_set4scale(ylen, d0_scale);
-        d0_out=d0_scale;
-        d0_0=d0_scale;
+        parameter_set4scale(ctx, ctx.ylen, ctx.opt->d0_scale);
+        d0_out=ctx.opt->d0_scale;
+        d0_0=ctx.opt->d0_scale;
         //Lnorm_0=ylen;
-        Lnorm_d0=Lnorm_0;
-        local_d0_search = d0_search;
-        TM5 = TMscore8_search(xtm, ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
-        TM_0=TM5;
+        ctx.Lnorm_d0=Lnorm_0;
+        local_d0_search = ctx.d0_search;
+        ctx.TM5 = TMscore8_search(ctx, ctx.xtm, ctx.ytm, n_ali8, t0, u0, simplify_step, score_sum_method, &rmsd, local_d0_search);
+        TM_0=ctx.TM5;
+
+        if (ctx.opt->all_opt)
+        {
+            //the same d0 normalized by chain 1, for chain 2 onto chain 1
+            double t5[3], u5[3][3];
+            parameter_set4scale(ctx, ctx.xlen, ctx.opt->d0_scale);
+            local_d0_search = ctx.d0_search;
+            ctx.TM5_rev = TMscore8_search(ctx, ctx.xtm, ctx.ytm, n_ali8, t5, u5, simplify_step, score_sum_method, &rmsd, local_d0_search);
+        }
     }
 
     /* print result */
-    if (outfmt_opt==0) print_version();
-    output_results(xname, yname, xlen, ylen, t0, u0, TM1, TM2, rmsd0, d0_out,
+    if (outfmt_opt==0)
+    {
+        stringstream buf;
+        print_version(buf);
+        ctx.out+=buf.str();
+    }
+    output_results(ctx, xname, yname, ctx.xlen, ctx.ylen, t0, u0, TM1, TM2, rmsd0, d0_out,
         m1, m2, n_ali8, n_ali, TM_0, Lnorm_0, d0_0, fname_matrix,
         dir1_opt, dir2_opt, outfmt_opt, ter_opt);
 
     /* free memory */
-    delete [] invmap0;
-    delete [] invmap;
-    delete [] m1;
-    delete [] m2;
+    arena_release(ctx.arena, mark);
     return 0; // zero for no exception
 }
@@ -0,0 +1,168 @@
+/*
+===============================================================================
+   TMclient sends a query structure to a TMalign -server and prints the
+   outfmt 2 lines of the answer. With -n and -c it works as a load generator:
+   the query is sent n times over c concurrent connections, and the latency
+   of the requests and the throughput of the server are reported instead.
+===============================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "basic_define.h"
+#include "unix_socket.h"
+
+using namespace std;
+
+void PrintErrorAndQuit(string sErrorString)
+{
+	cout << sErrorString << endl;
+	exit(1);
+}
+
+void print_help()
+{
+    cout <<
+"Usage: TMclient socket_path chain1 [Options]\n"
+"\n"
+"    Align PDB file 'chain1' to the chains served by\n"
+"    $ TMalign -server socket_path ...\n"
+"\n"
+"Options:\n"
+"    -n    Number of times the query is sent (default 1). If n or c is\n"
+"          larger than 1, latency and throughput are printed instead of\n"
+"          the alignments.\n"
+"\n"
+"    -c    Number of concurrent connections (default 1)\n"
+"\n"
+"Example usages:\n"
+"    TMclient /tmp/TMalign.sock query.pdb\n"
+"    TMclient /tmp/TMalign.sock query.pdb -n 1000 -c 16\n"
+    <<endl;
+    exit(EXIT_SUCCESS);
+}
+
+/* send request on a new connection and receive the answer */
+bool query_server(const char *socket_path, const string &request,
+    string &reply)
+{
+    int fd=connect_socket(socket_path);
+    if (fd<0) return false;
+    bool ok=send_all(fd, request) && shutdown(fd, SHUT_WR)==0 &&
+        recv_all(fd, reply);
+    close(fd);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) print_help();
+
+    char socket_path[MAXLEN], query_name[MAXLEN];
+    int n_request=1;      // -n
+    int n_connection=1;   // -c
+
+    int nameIdx = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if ( !strcmp(argv[i],"-n") && i < (argc-1) )
+        {
+            n_request=atoi(argv[i + 1]); i++;
+        }
+        else if ( !strcmp(argv[i],"-c") && i < (argc-1) )
+        {
+            n_connection=atoi(argv[i + 1]); i++;
+        }
+        else if ( !strcmp(argv[i],"-h") ) print_help();
+        else
+        {
+            if (nameIdx == 0) strcpy(socket_path, argv[i]);
+            else if (nameIdx == 1) strcpy(query_name, argv[i]);
+            nameIdx++;
+        }
+    }
+    if (nameIdx != 2) PrintErrorAndQuit("Please provide socket_path and chain1");
+    if (n_request<1 || n_connection<1)
+        PrintErrorAndQuit("-n and -c should be >0");
+
+    /* the request is the name of the query followed by its PDB file */
+    ifstream fin(query_name);
+    if (! fin.is_open())
+    {
+        char message[5000];
+        sprintf(message, "Can not open file: %s\n", query_name);
+        PrintErrorAndQuit(message);
+    }
+    stringstream request_stream;
+    request_stream<<query_name<<'\n'<<fin.rdbuf();
+    fin.close();
+    const string request=request_stream.str();
+
+    if (n_request==1 && n_connection==1)
+    {
+        string reply;
+        if (!query_server(socket_path, request, reply))
+        {
+            char message[5000];
+            sprintf(message, "Can not query server at socket: %s\n", socket_path);
+            PrintErrorAndQuit(message);
+        }
+        if (reply.compare(0, 5, "ERROR")==0) PrintErrorAndQuit(reply);
+        cout<<"#PDBchain1\tPDBchain2\tTM1\tTM2\tRMSD\tID1\tID2\tIDali\tL1\tL2\tLali"<<endl;
+        cout<<reply<<flush;
+        return 0;
+    }
+
+    /* load generator: each connection thread takes the next request until
+     * all are sent, and records the latency of each request */
+    if (n_connection>n_request) n_connection=n_request;
+    vector<double> latency(n_request, -1); // in milliseconds, -1 if failed
+    atomic<int> next_request(0);
+    typedef chrono::steady_clock clock_type;
+    clock_type::time_point t0=clock_type::now();
+    vector<thread> pool;
+    for (int c=0;c<n_connection;c++) pool.push_back(thread([&]()
+    {
+        string reply;
+        for (int k=next_request++;k<n_request;k=next_request++)
+        {
+            clock_type::time_point t1=clock_type::now();
+            if (query_server(socket_path, request, reply) &&
+                reply.compare(0, 5, "ERROR"))
+                latency[k]=chrono::duration<double, milli>(
+                    clock_type::now()-t1).count();
+        }
+    }));
+    for (int c=0;c<n_connection;c++) pool[c].join();
+    double total=chrono::duration<double>(clock_type::now()-t0).count();
+
+    vector<double> ok_latency;
+    for (int k=0;k<n_request;k++)
+        if (latency[k]>=0) ok_latency.push_back(latency[k]);
+    int n_ok=ok_latency.size();
+    printf("Requests: %d sent, %d failed, %d concurrent connections\n",
+        n_request, n_request-n_ok, n_connection);
+    printf("Total time: %.3f s, throughput: %.2f queries/s\n",
+        total, n_ok/total);
+    if (n_ok)
+    {
+        sort(ok_latency.begin(), ok_latency.end());
+        double sum=0;
+        for (int k=0;k<n_ok;k++) sum+=ok_latency[k];
+        printf("Latency (ms): mean %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+            sum/n_ok, ok_latency[n_ok/2], ok_latency[(int)(n_ok*0.9)],
+            ok_latency[(int)(n_ok*0.99)], ok_latency[n_ok-1]);
+    }
+    return 0;
+}
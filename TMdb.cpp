@@ -0,0 +1,123 @@
+/*
+===============================================================================
+   TMdb converts a list of PDB files into one binary database, which TMalign
+   maps with -db1 or -db2 instead of reading the PDB files. Besides the CA
+   coordinates, sequence and residue numbers, the database holds the
+   secondary structure and the longest continuous fragment of each chain,
+   which TMalign would otherwise compute again for every alignment.
+
+   The layout of the database is described in structure_store.h.
+===============================================================================
+*/
+#include "basic_define.h"
+#include "global_var.h"
+#include "param_set.h"
+
+using namespace std;
+
+
+#include "basic_fun.h"
+#include "NW.h"
+#include "Kabsch.h"
+#include "TMalign.h"
+#include "structure_store.h"
+
+void print_help()
+{
+    cout <<
+"Usage: TMdb chain_list output.db [Options]\n"
+"\n"
+"    Convert the PDB chains listed by 'chain_list' into the TM-align\n"
+"    database 'output.db', to be searched by TMalign -db1 or -db2.\n"
+"    Chains that cannot be read are skipped with a warning.\n"
+"\n"
+"Options:\n"
+"    -dir     folder of the files listed by 'chain_list'\n"
+"             $ TMdb -dir chain_folder/ chain_list output.db\n"
+"\n"
+"    -suffix  add file name suffix to files listed by chain_list\n"
+"\n"
+"    -atom    4-character atom name used to represent a residue\n"
+"             default is \" CA \" (note the space before and after CA)\n"
+"\n"
+"    -ter     Strings to mark the end of a chain, as in TMalign (default 3)\n"
+"\n"
+"    Options -atom and -ter apply when the database is made; TMalign\n"
+"    ignores them for chains read from a database.\n"
+    <<endl;
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) print_help();
+
+    clock_t t1, t2;
+    t1 = clock();
+
+    char list_name[MAXLEN], db_name[MAXLEN];
+    int ter_opt = 3;        // TER, END, or different chainID
+    string atom_opt=" CA "; // use C alpha atom to represent a residue
+    string suffix_opt="";   // set -suffix to empty
+    string dir_opt="";      // set -dir to empty
+
+    int nameIdx = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if ( !strcmp(argv[i],"-ter") && i < (argc-1) )
+        {
+            ter_opt=atoi(argv[i + 1]); i++;
+        }
+        else if ( !strcmp(argv[i],"-atom") && i < (argc-1) )
+        {
+            atom_opt=argv[i + 1]; i++;
+            if (atom_opt.size()!=4)
+                PrintErrorAndQuit("ERROR! atom name must be 4 characters, including space.");
+        }
+        else if ( !strcmp(argv[i],"-dir") && i < (argc-1) )
+        {
+            dir_opt=argv[i + 1]; i++;
+        }
+        else if ( !strcmp(argv[i],"-suffix") && i < (argc-1) )
+        {
+            suffix_opt=argv[i + 1]; i++;
+        }
+        else if ( !strcmp(argv[i],"-h") ) print_help();
+        else
+        {
+            if (nameIdx == 0) strcpy(list_name, argv[i]);
+            else if (nameIdx == 1) strcpy(db_name, argv[i]);
+            nameIdx++;
+        }
+    }
+    if (nameIdx != 2) PrintErrorAndQuit("Please provide chain_list and output.db");
+
+    /* parse file list. Chains are named in the database as TMalign -dir1
+     * and -dir2 print them, i.e. without the folder */
+    vector<string> chain_list, chain_name;
+    ifstream fp(list_name);
+    if (! fp.is_open())
+    {
+        char message[5000];
+        sprintf(message, "Can not open file: %s\n", list_name);
+        PrintErrorAndQuit(message);
+    }
+    string line;
+    while (fp.good())
+    {
+        getline(fp, line);
+        if (! line.size()) continue;
+        chain_name.push_back(Trim(line)+suffix_opt);
+        chain_list.push_back(dir_opt+chain_name.back());
+    }
+    fp.close();
+
+    int n_chain=write_db(db_name, chain_list, chain_name, ter_opt, atom_opt);
+    cout<<"Wrote "<<n_chain<<" of "<<chain_list.size()<<" chains to "
+        <<db_name<<endl;
+
+    t2 = clock();
+    float diff = ((float)t2 - (float)t1)/CLOCKS_PER_SEC;
+    printf("Total running time is %5.2f seconds\n", diff);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+===============================================================================
+   TMmerge joins the outfmt 2 outputs of TMalign -shard i/N runs into the
+   output of a single run. Each shard output starts with a "#shard i/N"
+   line; the files may be given in any order, but all N shards of the same
+   run must be present.
+===============================================================================
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+void PrintErrorAndQuit(string sErrorString)
+{
+	cout << sErrorString << endl;
+	exit(1);
+}
+
+void print_help()
+{
+    cout <<
+"Usage: TMmerge shard_output1 shard_output2 ...\n"
+"\n"
+"    Print the outfmt 2 outputs of all shards of TMalign -shard i/N in the\n"
+"    order of a single TMalign run.\n"
+"\n"
+"Example usages:\n"
+"    TMalign chain1 -dir2 chain2_folder/ chain2_list -outfmt 2 -shard 0/2 > out0\n"
+"    TMalign chain1 -dir2 chain2_folder/ chain2_list -outfmt 2 -shard 1/2 > out1\n"
+"    TMmerge out1 out0 > out\n"
+    <<endl;
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || !strcmp(argv[1],"-h")) print_help();
+
+    int n_shard=0;
+    vector<string> shard_file; // file of each shard
+    char message[5000];
+    string line;
+    for (int f=1;f<argc;f++)
+    {
+        ifstream fp(argv[f]);
+        if (! fp.is_open())
+        {
+            sprintf(message, "Can not open file: %s\n", argv[f]);
+            PrintErrorAndQuit(message);
+        }
+        int s=-1, n=0;
+        while (getline(fp, line) && line.compare(0, 1, "#")==0)
+            if (sscanf(line.c_str(), "#shard\t%d/%d", &s, &n)==2) break;
+        fp.close();
+        if (s<0 || n<1 || s>=n)
+        {
+            sprintf(message, "No \"#shard i/N\" line in %s\n", argv[f]);
+            PrintErrorAndQuit(message);
+        }
+        if (n_shard==0)
+        {
+            n_shard=n;
+            shard_file.assign(n_shard, "");
+        }
+        if (n!=n_shard)
+        {
+            sprintf(message, "%s is a shard of %d, not %d\n", argv[f], n, n_shard);
+            PrintErrorAndQuit(message);
+        }
+        if (shard_file[s].size())
+        {
+            sprintf(message, "%s and %s are both shard %d\n",
+                shard_file[s].c_str(), argv[f], s);
+            PrintErrorAndQuit(message);
+        }
+        shard_file[s]=argv[f];
+    }
+    for (int s=0;s<n_shard;s++)
+    {
+        if (shard_file[s].size()) continue;
+        sprintf(message, "Shard %d of %d is missing\n", s, n_shard);
+        PrintErrorAndQuit(message);
+    }
+
+    /* alignment lines of each shard, in shard order */
+    cout<<"#PDBchain1\tPDBchain2\tTM1\tTM2\tRMSD\tID1\tID2\tIDali\tL1\tL2\tLali"<<endl;
+    for (int s=0;s<n_shard;s++)
+    {
+        ifstream fp(shard_file[s].c_str());
+        while (getline(fp, line))
+        {
+            if (line.size()==0 || line.compare(0, 1, "#")==0 ||
+                line.compare(0, 18, "Total running time")==0) continue;
+            cout<<line<<'\n';
+        }
+        fp.close();
+    }
+    cout<<flush;
+    return 0;
+}
@@ -24,15 +24,21 @@
 #define dimmax 30000
 #define charmax 10
 
-#define NMAX 5000
-#define NMAX2 90000
 #define ASCIILimit 123
 
 #define MAXLEN 10000 //maximum length of filenames
+
+//floating point type of the coordinates, distances and DP values of the
+//alignment engine. -DTMALIGN_FLOAT (make TMalign_float) builds it in single
+//precision; superpositions, rotations and score sums stay double
+#ifdef TMALIGN_FLOAT
+typedef float tm_real;
+#else
+typedef double tm_real;
+#endif
 #include <string>// TO use string variables
 
 using namespace std;
 
-string **atom1, **atom2;// atom name, atom1(i,j): the name of jth atom for ith residue
 
 #endif
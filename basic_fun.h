@@ -16,6 +16,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <math.h>
 #include <time.h>
 #include <string.h>
@@ -43,6 +44,25 @@ void PrintErrorAndQuit(string sErrorString)
 }
 
 
+/* printf-style formatting appended to buf, so that the output of one
+ * alignment can be collected and printed later */
+void sprintf_append(string &buf, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int len=vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (len<=0) return;
+
+    size_t old_len=buf.size();
+    buf.resize(old_len+len+1);
+    va_start(ap, format);
+    vsnprintf(&buf[old_len], len+1, format, ap);
+    va_end(ap);
+    buf.resize(old_len+len);
+}
+
+
 template <class A> void NewArray(A *** array, int Narray1, int Narray2)
 {
   *array=new A* [Narray1];
@@ -111,7 +131,7 @@ void get_xyz(string line, double *x, double *y, double *z, char *resname, int *n
 	sscanf(cstr, "%d", no);
 }
 
-int get_PDB_lines(const char *filename, vector<string> &PDB_lines, 
+int get_PDB_lines(istream &fin, vector<string> &PDB_lines, 
     const int ter_opt=3, const string atom_opt=" CA ")
 {
     int i=0; // resi
@@ -119,50 +139,165 @@ int get_PDB_lines(const char *filename, vector<string> &PDB_lines,
     char chainID=0;
 	string resn="";
     
-    ifstream fin (filename);
-    if (fin.is_open())
+    while (fin.good())
     {
-		while (fin.good())
+        getline(fin, line);
+        if (i > 0)
+        {
+            if      (ter_opt>=1 && line.compare(0,3,"END")==0) break;
+            else if (ter_opt>=3 && line.compare(0,3,"TER")==0) break;
+        }
+        if (line.compare(0, 6, "ATOM  ")==0 && line.size()>=54 &&
+           (line[16]==' ' || line[16]=='A'))
         {
-            getline(fin, line);
-			if (i > 0)
+            if (line.compare(12, 4, atom_opt)==0)
             {
-                if      (ter_opt>=1 && line.compare(0,3,"END")==0) break;
-                else if (ter_opt>=3 && line.compare(0,3,"TER")==0) break;
+                if (!chainID) chainID=line[21];
+                else if (ter_opt>=2 && chainID!=line[21]) break;
+
+                if (resn==line.substr(22,5))
+                    cerr<<"Warning! Duplicated residue "<<resn<<endl;
+                resn=line.substr(22,5);
+
+                // change residue index in line
+                stringstream i8_stream;
+                i8_stream << i;
+                i8=i8_stream.str();
+                if (i8.size()<4)
+                {
+                    i8=string(4-i8.size(), ' ')+i8;
+                }
+                line=line.substr(0,22)+i8+line.substr(26);
+                PDB_lines.push_back(line);
+                i++;
             }
-			if (line.compare(0, 6, "ATOM  ")==0 && line.size()>=54 &&
-               (line[16]==' ' || line[16]=='A'))
-			{
-				if (line.compare(12, 4, atom_opt)==0)
-				{
-                    if (!chainID) chainID=line[21];
-                    else if (ter_opt>=2 && chainID!=line[21]) break;
-
-                    if (resn==line.substr(22,5))
-                        cerr<<"Warning! Duplicated residue "<<resn<<endl;
-                    resn=line.substr(22,5);
-
-                    // change residue index in line
-                    stringstream i8_stream;
-                    i8_stream << i;
-                    i8=i8_stream.str();
-                    if (i8.size()<4)
-                    {
-                        i8=string(4-i8.size(), ' ')+i8;
-                    }
-                    line=line.substr(0,22)+i8+line.substr(26);
-                    PDB_lines.push_back(line);
-                    i++;
-				}
-			}
         }
-        fin.close();
     }
-    else return 0;
     line.clear();
     return i;
 }
 
+/* len rounded up to whole 64-byte lines of tm_real */
+inline int coord_stride(int len)
+{
+    const int line=64/sizeof(tm_real);
+    return (len+line-1)&~(line-1);
+}
+
+/* allocate coordinates of len residues. Each of x, y and z starts on its
+ * own 64-byte boundary, so that loops over them run on aligned vectors */
+void NewCoord(coord_array &a, int len)
+{
+    int stride=coord_stride(len);
+    void *block=NULL;
+    if (posix_memalign(&block, 64, sizeof(tm_real)*3*(stride>0?stride:1)))
+        PrintErrorAndQuit("Can not allocate coordinates\n");
+    a.x=(tm_real *)block;
+    a.y=a.x+stride;
+    a.z=a.y+stride;
+}
+
+void DeleteCoord(coord_array &a)
+{
+    free(a.x);
+    a.x=a.y=a.z=NULL;
+}
+
+TMalign_arena::~TMalign_arena()
+{
+    while (old)
+    {
+        char *next=*(char **)old;
+        free(old);
+        old=next;
+    }
+    free(buf);
+}
+
+/* n elements of type A from arena, 64-byte aligned */
+template <class A> A *arena_alloc(TMalign_arena &arena, size_t n)
+{
+    size_t bytes=(sizeof(A)*n+63)&~(size_t)63;
+    if (arena.used+bytes>arena.size)
+    {
+        // keep buf, which may hold arrays in use, until arena_reset
+        if (arena.buf)
+        {
+            *(char **)arena.buf=arena.old;
+            arena.old=arena.buf;
+        }
+        size_t size=2*arena.size;
+        if (size<bytes+64) size=bytes+64; // 64 bytes for the link to old
+        arena.buf=NULL;
+        if (posix_memalign((void **)&arena.buf, 64, size))
+            PrintErrorAndQuit("Can not allocate memory\n");
+        arena.size=size;
+        arena.used=64;
+    }
+    A *array=(A *)(arena.buf+arena.used);
+    arena.used+=bytes;
+    return array;
+}
+
+/* the arena position, to give back all arrays taken after it */
+inline size_t arena_mark(const TMalign_arena &arena)
+{
+    return arena.used;
+}
+
+/* give back the arrays taken after mark. If a new block was started since
+ * mark, part of the space given back stays unused until arena_reset */
+inline void arena_release(TMalign_arena &arena, size_t mark)
+{
+    if (mark<arena.used) arena.used=mark;
+}
+
+/* give back all arrays, and free the outgrown blocks */
+void arena_reset(TMalign_arena &arena)
+{
+    while (arena.old)
+    {
+        char *next=*(char **)arena.old;
+        free(arena.old);
+        arena.old=next;
+    }
+    arena.used=64;
+}
+
+/* coordinates of len residues from arena, as NewCoord */
+void arena_coord(TMalign_arena &arena, coord_array &a, int len)
+{
+    int stride=coord_stride(len);
+    a.x=arena_alloc<tm_real>(arena, 3*stride);
+    a.y=a.x+stride;
+    a.z=a.y+stride;
+}
+
+/* copy residue i of b to residue k of a */
+inline void copy_coord(coord_array &a, int k, const coord_array &b, int i)
+{
+    a.x[k]=b.x[i];
+    a.y[k]=b.y[i];
+    a.z[k]=b.z[i];
+}
+
+/* residues i, i+1, ... of a, without copying them */
+inline coord_array coord_slice(const coord_array &a, int i)
+{
+    coord_array s={a.x+i, a.y+i, a.z+i};
+    return s;
+}
+
+int get_PDB_lines(const char *filename, vector<string> &PDB_lines, 
+    const int ter_opt=3, const string atom_opt=" CA ")
+{
+    ifstream fin (filename);
+    if (!fin.is_open()) return 0;
+    int i=get_PDB_lines(fin, PDB_lines, ter_opt, atom_opt);
+    fin.close();
+    return i;
+}
+
 int read_PDB(const vector<string> &PDB_lines, double **a, char *seq, int *resno)
 {
     int i;
@@ -172,6 +307,24 @@ int read_PDB(const vector<string> &PDB_lines, double **a, char *seq, int *resno)
     return i;
 }
 
+/* copy a parsed chain into the arrays of one alignment */
+int copy_pdb_chain(const pdb_chain &chain, coord_array a, char *seq,
+    int *resno, int *sec)
+{
+    int i;
+    for (i=0;i<chain.len;i++)
+    {
+        a.x[i]=chain.xyz[3*i];
+        a.y[i]=chain.xyz[3*i+1];
+        a.z[i]=chain.xyz[3*i+2];
+        seq[i]=chain.seq[i];
+        resno[i]=chain.resno[i];
+        sec[i]=chain.sec[i];
+    }
+    seq[i]='\0';
+    return i;
+}
+
 double dist(double x[3], double y[3])
 {
 	double d1=x[0]-y[0];
@@ -181,6 +334,24 @@ double dist(double x[3], double y[3])
     return (d1*d1 + d2*d2 + d3*d3);
 }
 
+/* distance square of residue i of a and residue j of b */
+inline tm_real dist(const coord_array &a, int i, const coord_array &b, int j)
+{
+    tm_real d1=a.x[i]-b.x[j];
+    tm_real d2=a.y[i]-b.y[j];
+    tm_real d3=a.z[i]-b.z[j];
+    return (d1*d1 + d2*d2 + d3*d3);
+}
+
+/* distance square of point x and residue j of b */
+inline tm_real dist(const tm_real x[3], const coord_array &b, int j)
+{
+    tm_real d1=x[0]-b.x[j];
+    tm_real d2=x[1]-b.y[j];
+    tm_real d3=x[2]-b.z[j];
+    return (d1*d1 + d2*d2 + d3*d3);
+}
+
 double dot(double *a, double *b)
 {
     return (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
@@ -193,12 +364,48 @@ void transform(double t[3], double u[3][3], double *x, double *x1)
     x1[2]=t[2]+dot(&u[2][0], x);
 }
 
-void do_rotation(double **x, double **x1, int len, double t[3], double u[3][3])
+/* t and u rounded to tm_real, for rotating coordinates in tm_real */
+struct tm_rotation
+{
+    tm_real t[3], u[3][3];
+
+    tm_rotation(const double t0[3], const double u0[3][3])
+    {
+        for (int i=0;i<3;i++)
+        {
+            t[i]=t0[i];
+            for (int j=0;j<3;j++) u[i][j]=u0[i][j];
+        }
+    }
+};
+
+/* transform residue i of x */
+inline void transform(const tm_rotation &r, const coord_array &x, int i,
+    tm_real *x1)
+{
+    x1[0]=r.t[0]+(r.u[0][0]*x.x[i] + r.u[0][1]*x.y[i] + r.u[0][2]*x.z[i]);
+    x1[1]=r.t[1]+(r.u[1][0]*x.x[i] + r.u[1][1]*x.y[i] + r.u[1][2]*x.z[i]);
+    x1[2]=r.t[2]+(r.u[2][0]*x.x[i] + r.u[2][1]*x.y[i] + r.u[2][2]*x.z[i]);
+}
+
+inline void transform(const double t[3], const double u[3][3],
+    const coord_array &x, int i, tm_real *x1)
 {
+    transform(tm_rotation(t, u), x, i, x1);
+}
+
+void do_rotation(const coord_array &x, coord_array &x1, int len, double t[3],
+    double u[3][3])
+{
+    const tm_rotation r(t, u);
+    const tm_real *__restrict__ xx=x.x, *__restrict__ xy=x.y, *__restrict__ xz=x.z;
+    tm_real *__restrict__ x1x=x1.x, *__restrict__ x1y=x1.y, *__restrict__ x1z=x1.z;
     for(int i=0; i<len; i++)
     {
-        transform(t, u, &x[i][0], &x1[i][0]);
-    }    
+        x1x[i]=r.t[0]+(r.u[0][0]*xx[i] + r.u[0][1]*xy[i] + r.u[0][2]*xz[i]);
+        x1y[i]=r.t[1]+(r.u[1][0]*xx[i] + r.u[1][1]*xy[i] + r.u[1][2]*xz[i]);
+        x1z[i]=r.t[2]+(r.u[2][0]*xx[i] + r.u[2][1]*xy[i] + r.u[2][2]*xz[i]);
+    }
 }
 
 /* strip white space at the begining or end of string */
@@ -1,36 +1,104 @@
-const char *TMalign_version="20180604";   //version 
- 
- 
-//global variables
-double D0_MIN;                    //for d0
-double Lnorm;                     //normalization length
-double score_d8,d0,d0_search,dcu0;//for TMscore search
-double **score;            		  //Input score table for dynamic programming
-bool   **path;                    //for dynamic programming  
-double **val;                     //for dynamic programming  
-int    xlen, ylen, minlen;        //length of proteins
-int tempxlen, tempylen;
-double **xa, **ya;      //for input vectors xa[0...xlen-1][0..2], ya[0...ylen-1][0..2]
-                        //in general, ya is regarded as native structure --> superpose xa onto ya
-int    *xresno, *yresno;//residue numbers, used in fragment gapless threading 
-double **xtm, **ytm;    //for TMscore search engine
-double **xt;            //for saving the superposed version of r_1 or xtm
-char   *seqx, *seqy;    //for the protein sequence 
-int    *secx, *secy;    //for the secondary structure 
-double **r1, **r2;      //for Kabsch rotation 
-double t[3], u[3][3];   //Kabsch translation vector and rotation matrix
-
-char sequence[10][MAXLEN];// get value from alignment file
-double TM_ali, rmsd_ali;  // TMscore and rmsd from standard_TMscore func, 
-int L_ali;                // Aligned length from standard_TMscore func, 
-
-//argument variables
-char out_reg[MAXLEN];
-double Lnorm_ass, Lnorm_d0, d0_scale, d0A, d0B, d0u, d0a;
-bool o_opt, a_opt, u_opt, d_opt;
-bool i_opt;// flags for -i, with user given initial alignment file
-bool m_opt;// flags for -m, output rotation matrix
-bool I_opt;// flags for -I, stick to user given initial alignment file
-bool fast_opt; // flags for -fast, fast but inaccurate alignment
-
-double TM3, TM4, TM5;
+const char *TMalign_version="20180604";   //version
+
+
+//argument variables, set once by main() and read-only during alignment
+struct TMalign_opt
+{
+    char out_reg[MAXLEN];     //-o, file name of superposed structure
+    double Lnorm_ass;         //-u, user assigned normalization length
+    double d0_scale;          //-d, user assigned d0
+    bool o_opt, a_opt, u_opt, d_opt;
+    bool i_opt;// flags for -i, with user given initial alignment file
+    bool m_opt;// flags for -m, output rotation matrix
+    bool I_opt;// flags for -I, stick to user given initial alignment file
+    bool fast_opt; // flags for -fast, fast but inaccurate alignment
+    bool all_opt;  // flags for -all-vs-all, also output chain2 onto chain1
+    double dp_mem; //-dpmem, MB of DP moves kept before rows are recomputed
+    int dp_threads;//threads of the DP and TMscore8_search of one pair,
+                   //-threads for a single pair
+
+    char sequence[10][MAXLEN];// get value from alignment file
+};
+
+//coordinates of a set of residues, x[i], y[i], z[i] for residue i. The
+//three arrays are 64-byte aligned parts of one block allocated by NewCoord
+struct coord_array
+{
+    tm_real *x, *y, *z;
+};
+
+//one PDB chain as served to the alignment, read-only. The arrays belong to
+//whoever filled the structure, e.g. a structure_store or a database file.
+struct pdb_chain
+{
+    int len;              //number of residues, 0 if the file cannot be read
+    const double *xyz;    //coordinates, xyz[3*i..3*i+2] for residue i
+    const char *seq;      //one letter sequence, not '\0' terminated
+    const int *resno;     //residue numbers
+    const char *sec;      //secondary structure from make_sec
+    int frag[2][2];       //start and end of find_max_frag, [1] for -fast
+};
+
+//grow-only workspace of a TMalign_ctx, reused by all its alignments.
+//Arrays are taken from it by arena_alloc and given back in reverse order
+//by arena_release, or all at once by arena_reset at the end of the
+//alignment. An array that does not fit in buf is taken from a new block
+//twice as large; the outgrown blocks are freed by arena_reset.
+struct TMalign_arena
+{
+    char   *buf;        //current block
+    size_t size;        //bytes of buf
+    size_t used;        //bytes of buf in use
+    char   *old;        //outgrown blocks, each holding a pointer to the next
+
+    TMalign_arena(): buf(NULL), size(0), used(0), old(NULL) {}
+    ~TMalign_arena();
+    TMalign_arena(const TMalign_arena &)=delete;
+    TMalign_arena &operator=(const TMalign_arena &)=delete;
+};
+
+//alignment context: everything one call of TMalign_main reads or writes.
+//Each concurrent alignment needs its own TMalign_ctx; only opt is shared.
+struct TMalign_ctx
+{
+    const TMalign_opt *opt;
+
+    double D0_MIN;                    //for d0
+    double Lnorm;                     //normalization length
+    double score_d8,d0,d0_search,dcu0;//for TMscore search
+    unsigned char *path;              //for dynamic programming, 2-bit moves
+    int    dp_block;                  //rows per DP block, 0 if path has all
+    tm_real *val;                     //for dynamic programming, one row
+    bool   *diag;                     //for dynamic programming, one row
+    int    xlen, ylen, minlen;        //length of proteins
+    int tempxlen, tempylen;
+    coord_array xa, ya;     //for input vectors xa[0...xlen-1], ya[0...ylen-1]
+                            //in general, ya is regarded as native structure --> superpose xa onto ya
+    int    *xresno, *yresno;//residue numbers, used in fragment gapless threading
+    coord_array xtm, ytm;   //for TMscore search engine
+    coord_array xt;         //for saving the superposed version of r_1 or xtm
+    char   *seqx, *seqy;    //for the protein sequence
+    int    *secx, *secy;    //for the secondary structure
+    int    xfrag[2], yfrag[2];//start and end of the longest fragment
+    coord_array r1, r2;     //for Kabsch rotation
+    double t[3], u[3][3];   //Kabsch translation vector and rotation matrix
+
+    double TM_ali, rmsd_ali;  // TMscore and rmsd from standard_TMscore func,
+    int L_ali;                // Aligned length from standard_TMscore func,
+
+    double Lnorm_d0, d0A, d0B, d0u, d0a;
+    double TM3, TM4, TM5;
+    double TM5_rev;         //TM5 normalized by chain 1, for -all-vs-all
+
+    //final results of TMalign_main, for callers other than the text output
+    double TM_1, TM_2;      //TM-score normalized by length of chain 1 and 2
+    double rmsd0;           //RMSD of the n_ali8 aligned pairs
+    int n_ali8;             //aligned length
+    double seq_id;          //number of identical aligned residues
+    double t0[3], u0[3][3]; //superposition of chain 1 onto chain 2
+    string seqxA, seqM, seqyA;//alignment of chain 1 and chain 2
+
+    string out;             //text output of this alignment, printed by caller
+
+    TMalign_arena arena;    //arrays of the alignment
+};
@@ -0,0 +1,240 @@
+/*
+===============================================================================
+   libtmalign: the TM-align engine of TMalign as a static or shared library,
+   with the interface of libtmalign.h.
+
+   The engine headers define their functions and globals in the header, so
+   they are compiled here once, inside namespace tmalign_impl. Their symbols
+   therefore cannot clash with those of the program linking the library,
+   and only the tmalign_* functions are exported from libtmalign.so.
+===============================================================================
+*/
+#include "libtmalign.h"
+
+/* system headers of the engine, included before the namespace so that
+ * their include guards keep them out of it */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <string.h>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <string>
+#include <map>
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace tmalign_impl
+{
+#include "basic_define.h"
+#include "global_var.h"
+#include "param_set.h"
+#include "basic_fun.h"
+#include "NW.h"
+#include "Kabsch.h"
+#include "TMalign.h"
+#include "structure_store.h"
+#include "work_steal.h"
+}
+
+#define TMALIGN_API extern "C" __attribute__((visibility("default")))
+
+using namespace tmalign_impl;
+
+/* fill chain with the arrays of one structure of the interface */
+static void set_api_chain(const double *xyz, const char *seq, const int *resno,
+    const int len, pdb_chain &chain, pdb_chain_data &data)
+{
+    data.xyz.assign(xyz, xyz+3*len);
+    if (seq) data.seq.assign(seq, len);
+    else data.seq.assign(len, 'X');
+    replace(data.seq.begin(), data.seq.end(), '-', 'X'); // '-' is a gap
+    data.resno.resize(len);
+    for (int i=0;i<len;i++) data.resno[i]=resno?resno[i]:i;
+    make_chain_features(len, data.xyz.data(), data.resno.data(), data.sec,
+        chain.frag);
+
+    chain.len=len;
+    chain.xyz=data.xyz.data();
+    chain.seq=data.seq.data();
+    chain.resno=data.resno.data();
+    chain.sec=data.sec.data();
+}
+
+static char *copy_api_string(const string &str)
+{
+    char *buf=(char *)malloc(str.size()+1);
+    memcpy(buf, str.c_str(), str.size()+1);
+    return buf;
+}
+
+static void set_api_opt(const tmalign_options *api_opt, TMalign_opt &opt)
+{
+    tmalign_options default_opt;
+    if (!api_opt)
+    {
+        tmalign_default_options(&default_opt);
+        api_opt=&default_opt;
+    }
+    opt.o_opt = opt.i_opt = opt.m_opt = opt.I_opt = opt.all_opt = false;
+    opt.fast_opt = api_opt->fast;
+    opt.a_opt = api_opt->a_opt;
+    opt.u_opt = api_opt->Lnorm_ass>0;
+    opt.Lnorm_ass = api_opt->Lnorm_ass;
+    opt.d_opt = api_opt->d0_scale>0;
+    opt.d0_scale = api_opt->d0_scale;
+    opt.dp_mem = dp_mem_default;
+    opt.dp_threads = 1;
+}
+
+/* align chain1 onto chain2, leaving the results in ctx */
+static void align_api_chains(TMalign_ctx &ctx, const pdb_chain &chain1,
+    const pdb_chain &chain2)
+{
+    load_PDB_allocate_memory(ctx, chain1, chain2);
+    TMalign_main(ctx, "", "", "", 3, "", "", 0);
+    free_memory(ctx);
+}
+
+TMALIGN_API void tmalign_default_options(tmalign_options *opt)
+{
+    opt->fast=0;
+    opt->a_opt=0;
+    opt->Lnorm_ass=0;
+    opt->d0_scale=0;
+}
+
+TMALIGN_API int tmalign_align(const double *xyz1, const char *seq1,
+    const int *resno1, int len1, const double *xyz2, const char *seq2,
+    const int *resno2, int len2, const tmalign_options *api_opt,
+    tmalign_result *res)
+{
+    if (len1<=5) return 1; // TMalign quits on chains this short
+    if (len2<=5) return 2;
+
+    TMalign_opt opt;
+    set_api_opt(api_opt, opt);
+
+    pdb_chain chain1, chain2;
+    pdb_chain_data data1, data2;
+    set_api_chain(xyz1, seq1, resno1, len1, chain1, data1);
+    set_api_chain(xyz2, seq2, resno2, len2, chain2, data2);
+
+    TMalign_ctx ctx;
+    ctx.opt=&opt;
+    align_api_chains(ctx, chain1, chain2);
+
+    res->TM1=ctx.TM_1;
+    res->TM2=ctx.TM_2;
+    res->TM_a=opt.a_opt?ctx.TM3:0;
+    res->TM_u=opt.u_opt?ctx.TM4:0;
+    res->TM_d=opt.d_opt?ctx.TM5:0;
+    res->rmsd=ctx.rmsd0;
+    res->L_ali=ctx.n_ali8;
+    res->seq_id=ctx.n_ali8?ctx.seq_id/ctx.n_ali8:0;
+    for (int i=0;i<3;i++)
+    {
+        res->t[i]=ctx.t0[i];
+        for (int j=0;j<3;j++) res->u[i][j]=ctx.u0[i][j];
+    }
+    res->ali_len=ctx.seqM.size();
+    res->seqxA=copy_api_string(ctx.seqxA);
+    res->seqM=copy_api_string(ctx.seqM);
+    res->seqyA=copy_api_string(ctx.seqyA);
+    return 0;
+}
+
+TMALIGN_API int tmalign_align_batch(int n_chain, const double *const *xyz,
+    const char *const *seq, const int *len, long long n_pair,
+    const int *pair, const tmalign_options *api_opt, int n_thread,
+    int *stat, double *score, double *tu, int *y2x)
+{
+    for (long long k=0;k<2*n_pair;k++)
+        if (pair[k]<0 || pair[k]>=n_chain) return -1;
+    if (n_pair<=0) return 0; // nothing to align, nor jobs to cut
+    if (n_thread<=0) n_thread=thread::hardware_concurrency();
+    if (n_thread<=0) n_thread=1;
+
+    TMalign_opt opt;
+    set_api_opt(api_opt, opt);
+
+    /* per-chain features are computed once for the whole batch */
+    vector<pdb_chain> chain(n_chain);
+    vector<pdb_chain_data> data(n_chain);
+    run_work_stealing(n_chain, n_thread, [&](int c, int)
+    {
+        set_api_chain(xyz[c], seq?seq[c]:NULL, NULL, len[c], chain[c],
+            data[c]);
+    });
+
+    /* start of the y2x of each pair */
+    vector<long long> y2x_start(n_pair+1, 0);
+    for (long long k=0;k<n_pair;k++)
+        y2x_start[k+1]=y2x_start[k]+len[pair[2*k+1]];
+
+    /* jobs are blocks of pairs, so that the int job index of
+     * run_work_stealing covers any n_pair */
+    const long long block=(n_pair+(1<<20)-1)>>20;
+    int n_job=(n_pair+block-1)/block;
+    vector<TMalign_ctx> worker_ctx(n_thread); // arenas reused across jobs
+    run_work_stealing(n_job, n_thread, [&](int job, int w)
+    {
+        TMalign_ctx &ctx=worker_ctx[w];
+        ctx.opt=&opt;
+        long long k_end=min(n_pair, (job+1)*block);
+        for (long long k=job*block;k<k_end;k++)
+        {
+            const pdb_chain &chain1=chain[pair[2*k]];
+            const pdb_chain &chain2=chain[pair[2*k+1]];
+            int *k_y2x=y2x?y2x+y2x_start[k]:NULL;
+            if (k_y2x) for (int j=0;j<chain2.len;j++) k_y2x[j]=-1;
+            for (int m=0;m<5;m++) score[5*k+m]=0;
+            for (int m=0;m<12;m++) tu[12*k+m]=0;
+            stat[k]=(chain1.len<=5)?1:(chain2.len<=5)?2:0;
+            if (stat[k]) continue;
+
+            align_api_chains(ctx, chain1, chain2);
+            score[5*k]=ctx.TM_1;
+            score[5*k+1]=ctx.TM_2;
+            score[5*k+2]=ctx.rmsd0;
+            score[5*k+3]=ctx.n_ali8;
+            score[5*k+4]=ctx.n_ali8?ctx.seq_id/ctx.n_ali8:0;
+            for (int i=0;i<3;i++)
+            {
+                tu[12*k+i]=ctx.t0[i];
+                for (int j=0;j<3;j++) tu[12*k+3+3*i+j]=ctx.u0[i][j];
+            }
+            if (!k_y2x) continue;
+            int i=0, j=0;
+            for (size_t m=0;m<ctx.seqM.size();m++)
+            {
+                if (ctx.seqM[m]!=' ') k_y2x[j]=i;
+                if (ctx.seqxA[m]!='-') i++;
+                if (ctx.seqyA[m]!='-') j++;
+            }
+        }
+    });
+    return 0;
+}
+
+TMALIGN_API void tmalign_free_result(tmalign_result *res)
+{
+    free(res->seqxA);
+    free(res->seqM);
+    free(res->seqyA);
+    res->seqxA=res->seqM=res->seqyA=NULL;
+}
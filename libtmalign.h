@@ -0,0 +1,136 @@
+/*
+===============================================================================
+   C/C++ interface of libtmalign, the TM-align engine as a library.
+
+   Structures are passed as arrays in memory, so no PDB file is read or
+   written. Each call is independent of the others, and calls from several
+   threads may run at the same time.
+
+   $ make libtmalign.a libtmalign.so
+   $ cc prog.c -L. -ltmalign -lstdc++ -lm -pthread
+===============================================================================
+*/
+#ifndef LIBTMALIGN_H
+#define LIBTMALIGN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* options of TMalign with the same name. Use tmalign_default_options to
+ * initialize them */
+typedef struct tmalign_options
+{
+    int fast;          /* -fast */
+    int a_opt;         /* -a T, also normalize by average length */
+    double Lnorm_ass;  /* -u, also normalize by this length if >0 */
+    double d0_scale;   /* -d, also scale by this d0 if >0 */
+} tmalign_options;
+
+typedef struct tmalign_result
+{
+    double TM1;        /* TM-score normalized by length of chain 1 */
+    double TM2;        /* TM-score normalized by length of chain 2 */
+    double TM_a;       /* normalized by average length, with a_opt */
+    double TM_u;       /* normalized by Lnorm_ass, with Lnorm_ass>0 */
+    double TM_d;       /* scaled by d0_scale, with d0_scale>0 */
+    double rmsd;       /* RMSD of the aligned residues */
+    int L_ali;         /* aligned length */
+    double seq_id;     /* identical residues / aligned length */
+
+    /* superposition of chain 1 onto chain 2: x2 = t + u x1 */
+    double t[3];
+    double u[3][3];
+
+    /* alignment as printed by TMalign, '\0' terminated strings of length
+     * ali_len: chain 1 with gaps, ':' for residue pairs of d < 5 A (or
+     * d0_scale if set) and '.' for other aligned pairs, and chain 2 with
+     * gaps */
+    int ali_len;
+    char *seqxA;
+    char *seqM;
+    char *seqyA;
+} tmalign_result;
+
+void tmalign_default_options(tmalign_options *opt);
+
+/* align chain 1 (xyz1, seq1, len1) onto chain 2 (xyz2, seq2, len2).
+ * xyz holds the CA coordinates, x y z for each residue in turn. seq is the
+ * one letter sequence and may be NULL. resno, the residue numbers, may be
+ * NULL for residues numbered without gaps. opt may be NULL for default
+ * options.
+ * Return 0 on success, 1 or 2 if chain 1 or chain 2 has 5 or fewer
+ * residues. Free the result with tmalign_free_result. */
+int tmalign_align(const double *xyz1, const char *seq1, const int *resno1,
+    int len1, const double *xyz2, const char *seq2, const int *resno2,
+    int len2, const tmalign_options *opt, tmalign_result *res);
+
+void tmalign_free_result(tmalign_result *res);
+
+/* align a batch of pairs on n_thread threads, 0 for one per core. Chain c
+ * of the batch has len[c] residues with coordinates xyz[c], laid out as for
+ * tmalign_align, and sequence seq[c]; seq or seq[c] may be NULL. Pair k
+ * aligns chain pair[2*k] onto chain pair[2*k+1]. The arrays are only read,
+ * and the results of pair k are written to
+ *   stat[k]:          return value of tmalign_align for the pair
+ *   score[5*k..5*k+4]: TM1, TM2, rmsd, L_ali, seq_id
+ *   tu[12*k..12*k+11]: t, then u row by row
+ *   y2x:              if not NULL, for each residue j of chain 2 the
+ *                     aligned residue of chain 1, or -1. The y2x of the
+ *                     pairs follow each other in the order of the pairs.
+ * Return 0, or -1 if a chain index in pair is out of range. */
+int tmalign_align_batch(int n_chain, const double *const *xyz,
+    const char *const *seq, const int *len, long long n_pair,
+    const int *pair, const tmalign_options *opt, int n_thread,
+    int *stat, double *score, double *tu, int *y2x);
+
+#ifdef __cplusplus
+}
+
+#include <string>
+#include <vector>
+
+namespace tmalign
+{
+/* C++ form of tmalign_result */
+struct alignment
+{
+    double TM1, TM2, TM_a, TM_u, TM_d, rmsd;
+    int L_ali;
+    double seq_id;
+    double t[3], u[3][3];
+    std::string seqxA, seqM, seqyA;
+};
+
+/* align chain 1 onto chain 2, where xyz holds 3 coordinates per residue
+ * and seq may be empty. Return as tmalign_align */
+inline int align(const std::vector<double> &xyz1, const std::string &seq1,
+    const std::vector<double> &xyz2, const std::string &seq2,
+    alignment &aln, const tmalign_options *opt=NULL)
+{
+    tmalign_result res;
+    int stat=tmalign_align(xyz1.data(), seq1.size()?seq1.c_str():NULL, NULL,
+        xyz1.size()/3, xyz2.data(), seq2.size()?seq2.c_str():NULL, NULL,
+        xyz2.size()/3, opt, &res);
+    if (stat) return stat;
+
+    aln.TM1=res.TM1; aln.TM2=res.TM2;
+    aln.TM_a=res.TM_a; aln.TM_u=res.TM_u; aln.TM_d=res.TM_d;
+    aln.rmsd=res.rmsd;
+    aln.L_ali=res.L_ali;
+    aln.seq_id=res.seq_id;
+    for (int i=0;i<3;i++)
+    {
+        aln.t[i]=res.t[i];
+        for (int j=0;j<3;j++) aln.u[i][j]=res.u[i][j];
+    }
+    aln.seqxA=res.seqxA;
+    aln.seqM=res.seqM;
+    aln.seqyA=res.seqyA;
+    tmalign_free_result(&res);
+    return 0;
+}
+}
+#endif
+
+#endif
@@ -1,60 +1,63 @@
 #include <math.h>
 
-void parameter_set4search(int xlen, int ylen)
+const double dcu0_search=4.25; //distance cutoff of continuous fragments
+const double dp_mem_default=1024; //-dpmem, MB of DP moves for a full path
+
+void parameter_set4search(TMalign_ctx &ctx, int xlen, int ylen)
 {
 	//parameter initilization for searching: D0_MIN, Lnorm, d0, d0_search, score_d8
-	D0_MIN=0.5; 
-	dcu0=4.25;                       //update 3.85-->4.25
+	ctx.D0_MIN=0.5; 
+	ctx.dcu0=dcu0_search;                //update 3.85-->4.25
  
-	Lnorm=getmin(xlen, ylen);        //normaliz TMscore by this in searching
-    if(Lnorm<=19)                    //update 15-->19
+	ctx.Lnorm=getmin(xlen, ylen);        //normaliz TMscore by this in searching
+    if(ctx.Lnorm<=19)                    //update 15-->19
     {
-        d0=0.168;                   //update 0.5-->0.168
+        ctx.d0=0.168;                   //update 0.5-->0.168
     }
     else
     {
-        d0=(1.24*pow((Lnorm*1.0-15), 1.0/3)-1.8);
+        ctx.d0=(1.24*pow((ctx.Lnorm*1.0-15), 1.0/3)-1.8);
     }
-	D0_MIN=d0+0.8;              //this should be moved to above
-    d0=D0_MIN;                  //update: best for search    
+	ctx.D0_MIN=ctx.d0+0.8;              //this should be moved to above
+    ctx.d0=ctx.D0_MIN;                  //update: best for search    
 
 
-	d0_search=d0;	
-	if(d0_search>8) d0_search=8;
-	if(d0_search<4.5) d0_search=4.5;
+	ctx.d0_search=ctx.d0;	
+	if(ctx.d0_search>8) ctx.d0_search=8;
+	if(ctx.d0_search<4.5) ctx.d0_search=4.5;
 
 
-    score_d8=1.5*pow(Lnorm*1.0, 0.3)+3.5; //remove pairs with dis>d8 during search & final
+    ctx.score_d8=1.5*pow(ctx.Lnorm*1.0, 0.3)+3.5; //remove pairs with dis>d8 during search & final
 }
 
-void parameter_set4final(double len)
+void parameter_set4final(TMalign_ctx &ctx, double len)
 {
-	D0_MIN=0.5; 
+	ctx.D0_MIN=0.5; 
  
-	Lnorm=len;            //normaliz TMscore by this in searching
-    if(Lnorm<=21)         
+	ctx.Lnorm=len;            //normaliz TMscore by this in searching
+    if(ctx.Lnorm<=21)         
     {
-        d0=0.5;          
+        ctx.d0=0.5;          
     }
     else
     {
-        d0=(1.24*pow((Lnorm*1.0-15), 1.0/3)-1.8);
+        ctx.d0=(1.24*pow((ctx.Lnorm*1.0-15), 1.0/3)-1.8);
     }
-    if(d0<D0_MIN) d0=D0_MIN;   
+    if(ctx.d0<ctx.D0_MIN) ctx.d0=ctx.D0_MIN;   
 
-	d0_search=d0;	
-	if(d0_search>8) d0_search=8;
-	if(d0_search<4.5) d0_search=4.5;  
+	ctx.d0_search=ctx.d0;	
+	if(ctx.d0_search>8) ctx.d0_search=8;
+	if(ctx.d0_search<4.5) ctx.d0_search=4.5;  
 }
 
 
-void parameter_set4scale(int len, double d_s)
+void parameter_set4scale(TMalign_ctx &ctx, int len, double d_s)
 {
-	d0=d_s;          
-	Lnorm=len;            //normaliz TMscore by this in searching
+	ctx.d0=d_s;          
+	ctx.Lnorm=len;            //normaliz TMscore by this in searching
 
-	d0_search=d0;	
-	if(d0_search>8) d0_search=8;
-	if(d0_search<4.5) d0_search=4.5;  
+	ctx.d0_search=ctx.d0;	
+	if(ctx.d0_search>8) ctx.d0_search=8;
+	if(ctx.d0_search<4.5) ctx.d0_search=4.5;  
 }
 
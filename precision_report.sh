@@ -0,0 +1,35 @@
+#!/bin/sh
+# Deviation of the single precision engine, TMalign_float, from the double
+# precision TMalign on a reference set of chain pairs. The arguments select
+# the pairs as for TMalign, e.g.
+#   $ make TMalign TMalign_float
+#   $ ./precision_report.sh -dir1 chain1_folder/ chain1_list -dir2 chain2_folder/ chain2_list
+# Pairs whose TM-scores, RMSD or aligned length differ are listed, followed
+# by the largest and mean deviations over all pairs.
+
+dir=`dirname "$0"`
+double_out=`mktemp` || exit 1
+float_out=`mktemp` || exit 1
+trap 'rm -f "$double_out" "$float_out"' EXIT
+
+"$dir/TMalign" "$@" -outfmt 2 | grep -v '^Total' > "$double_out" || exit 1
+"$dir/TMalign_float" "$@" -outfmt 2 | grep -v '^Total' > "$float_out" || exit 1
+
+paste "$double_out" "$float_out" | awk -F'\t' '
+function abs(v) { return v<0 ? -v : v }
+/^#/ { print "#PDBchain1\tPDBchain2\tdTM1\tdTM2\tdRMSD\tLali\tLali_float"; next }
+{
+    d1=abs($14-$3); d2=abs($15-$4); dr=abs($16-$5)
+    if (d1>max1) max1=d1
+    if (d2>max2) max2=d2
+    if (dr>maxr) maxr=dr
+    sum+=d1+d2; n++
+    if ($11!=$22) n_lali++
+    if (d1>0 || d2>0 || dr>0 || $11!=$22)
+        printf "%s\t%s\t%.4f\t%.4f\t%.2f\t%d\t%d\n", $1, $2, $14-$3, $15-$4, $16-$5, $11, $22
+}
+END {
+    printf "pairs: %d, differing Lali: %d\n", n, n_lali
+    printf "max |dTM1|: %.4f, max |dTM2|: %.4f, mean |dTM|: %.6f, max |dRMSD|: %.2f\n", \
+        max1, max2, n ? sum/(2*n) : 0, maxr
+}'
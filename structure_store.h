@@ -0,0 +1,333 @@
+/*
+===============================================================================
+   Parse-once structure store for batch runs.
+
+   Every file listed by chain1_list and chain2_list is parsed once into its
+   coordinates, sequence and residue numbers, which are then kept for the
+   whole run and served read-only to every alignment. Before, each chain2 was
+   parsed again for every chain1.
+
+   The per-chain features that do not depend on the other chain, i.e. the
+   make_sec secondary structure and the find_max_frag fragment, are computed
+   at the same time.
+
+   A store can also serve the chains of a binary database written by TMdb.
+   The file is mapped read-only, so opening it costs no parsing, and all
+   processes that map the same database share its pages.
+
+   Database layout, in native byte order:
+     tmdb_header
+     tmdb_entry[n_chain]
+     one record per chain, each starting at a multiple of 8 bytes:
+         double xyz[3*len]; int resno[len]; char seq[len]; char sec[len];
+     names, '\0' terminated
+===============================================================================
+*/
+#ifndef STRUCTURE_STORE_H
+#define STRUCTURE_STORE_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+const char tmdb_magic[8]={'T','M','D','B','0','0','0','1'};
+
+struct tmdb_header
+{
+    char magic[8];
+    long long n_chain;
+    long long name_start;    // file offset of the names
+};
+
+struct tmdb_entry
+{
+    long long offset;        // file offset of the record
+    long long name_offset;   // offset of the name from name_start
+    int len;
+    int frag[2][2];
+    int pad;
+};
+
+/* arrays of a chain parsed from a PDB file */
+struct pdb_chain_data
+{
+    vector<double> xyz;
+    string seq;
+    vector<int> resno;
+    string sec;
+};
+
+struct structure_store
+{
+    vector<pdb_chain> chain;       // chains served to the alignments
+    deque<pdb_chain_data> data;    // arrays of parsed chains
+    map<string, int> index;        // parsed file name -> index in chain
+    vector<pair<void *, size_t> > db_map; // mapped databases
+};
+
+/* assign the secondary structure and the longest continuous fragments of a
+ * chain with coordinates xyz */
+void make_chain_features(const int len, const double *xyz, const int *resno,
+    string &sec, int frag[2][2])
+{
+    sec.assign(len, 1);
+    frag[0][0]=frag[0][1]=frag[1][0]=frag[1][1]=0;
+    if (len==0) return;
+
+    coord_array x;
+    NewCoord(x, len);
+    for (int i=0;i<len;i++)
+    {
+        x.x[i]=xyz[3*i];
+        x.y[i]=xyz[3*i+1];
+        x.z[i]=xyz[3*i+2];
+    }
+    vector<int> sec_int(len);
+    make_sec(x, len, &sec_int[0]);
+    for (int i=0;i<len;i++) sec[i]=sec_int[i];
+
+    find_max_frag(x, resno, len, dcu0_search, 4, &frag[0][0], &frag[0][1]);
+    find_max_frag(x, resno, len, dcu0_search, 8, &frag[1][0], &frag[1][1]);
+    DeleteCoord(x);
+}
+
+/* read PDB_lines of get_PDB_lines into chain, whose arrays are kept in data */
+int read_pdb_chain(const vector<string> &PDB_lines, pdb_chain &chain,
+    pdb_chain_data &data)
+{
+    int len=PDB_lines.size();
+    data.xyz.resize(3*len);
+    data.seq.resize(len);
+    data.resno.resize(len);
+    for (int i=0;i<len;i++)
+        get_xyz(PDB_lines[i], &data.xyz[3*i], &data.xyz[3*i+1],
+            &data.xyz[3*i+2], &data.seq[i], &data.resno[i]);
+    make_chain_features(len, data.xyz.data(), data.resno.data(), data.sec,
+        chain.frag);
+
+    chain.len=len;
+    chain.xyz=data.xyz.data();
+    chain.seq=data.seq.data();
+    chain.resno=data.resno.data();
+    chain.sec=data.sec.data();
+    return len;
+}
+
+/* parse one PDB file into chain, whose arrays are kept in data */
+int parse_pdb_chain(const char *filename, pdb_chain &chain,
+    pdb_chain_data &data, const int ter_opt=3, const string atom_opt=" CA ")
+{
+    vector<string> PDB_lines;
+    get_PDB_lines(filename, PDB_lines, ter_opt, atom_opt);
+    return read_pdb_chain(PDB_lines, chain, data);
+}
+
+/* copy chain into data, and point chain at the copy */
+void copy_pdb_chain_data(pdb_chain &chain, pdb_chain_data &data)
+{
+    data.xyz.assign(chain.xyz, chain.xyz+3*chain.len);
+    data.seq.assign(chain.seq, chain.len);
+    data.resno.assign(chain.resno, chain.resno+chain.len);
+    data.sec.assign(chain.sec, chain.len);
+
+    chain.xyz=data.xyz.data();
+    chain.seq=data.seq.data();
+    chain.resno=data.resno.data();
+    chain.sec=data.sec.data();
+}
+
+/* parse all files of name_list not yet in store, and save the index of each
+ * file in chain_idx. Files already parsed into cache are copied from it. */
+void add_to_store(structure_store &store, const vector<string> &name_list,
+    vector<int> &chain_idx, const int ter_opt=3, const string atom_opt=" CA ",
+    const structure_store *cache=NULL)
+{
+    chain_idx.resize(name_list.size());
+    for (size_t i=0;i<name_list.size();i++)
+    {
+        map<string, int>::iterator it=store.index.find(name_list[i]);
+        if (it!=store.index.end())
+        {
+            chain_idx[i]=it->second;
+            continue;
+        }
+        chain_idx[i]=store.chain.size();
+        store.index[name_list[i]]=chain_idx[i];
+        store.chain.push_back(pdb_chain());
+        store.data.push_back(pdb_chain_data());
+        map<string, int>::const_iterator c_it;
+        if (cache && (c_it=cache->index.find(name_list[i]))!=cache->index.end())
+        {
+            store.chain.back()=cache->chain[c_it->second];
+            copy_pdb_chain_data(store.chain.back(), store.data.back());
+        }
+        else parse_pdb_chain(name_list[i].c_str(), store.chain.back(),
+            store.data.back(), ter_opt, atom_opt);
+    }
+}
+
+/* map database filename and add all its chains to store. Names of the
+ * chains are appended to name_list and their indices to chain_idx */
+void add_db_to_store(structure_store &store, const char *filename,
+    vector<string> &name_list, vector<int> &chain_idx)
+{
+    char message[5000];
+    int fd=open(filename, O_RDONLY);
+    if (fd<0)
+    {
+        sprintf(message, "Can not open file: %s\n", filename);
+        PrintErrorAndQuit(message);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t size=st.st_size;
+    void *addr=MAP_FAILED;
+    if (size>=sizeof(tmdb_header))
+        addr=mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    const tmdb_header *header=(const tmdb_header *)addr;
+    if (addr==MAP_FAILED || memcmp(header->magic, tmdb_magic, 8))
+    {
+        sprintf(message, "Not a TMdb database: %s\n", filename);
+        PrintErrorAndQuit(message);
+    }
+    store.db_map.push_back(make_pair(addr, size));
+
+    /* the entry table and the names must lie within the file */
+    const long long file_size=size;
+    const long long max_chain=(file_size-(long long)sizeof(tmdb_header))/
+        (long long)sizeof(tmdb_entry);
+    if (header->n_chain<0 || header->n_chain>max_chain ||
+        header->name_start<(long long)(sizeof(tmdb_header)+
+        sizeof(tmdb_entry)*header->n_chain) ||
+        header->name_start>file_size)
+    {
+        sprintf(message, "Corrupt TMdb database: %s\n", filename);
+        PrintErrorAndQuit(message);
+    }
+
+    const char *base=(const char *)addr;
+    const tmdb_entry *entry=(const tmdb_entry *)(base+sizeof(tmdb_header));
+    const char *names=base+header->name_start;
+    const long long names_size=file_size-header->name_start;
+    const long long record_size=sizeof(double)*3+sizeof(int)+2;
+    pdb_chain chain;
+    for (long long c=0;c<header->n_chain;c++)
+    {
+        /* the record must be 8-byte aligned and lie within the file, the
+         * name must be '\0' terminated within the file, and the fragments
+         * must lie within the chain */
+        const tmdb_entry &e=entry[c];
+        bool ok=e.len>=0 && e.offset>=0 && e.offset%8==0 &&
+            e.offset<=file_size && e.len*record_size<=file_size-e.offset &&
+            e.name_offset>=0 && e.name_offset<names_size &&
+            memchr(names+e.name_offset, '\0', names_size-e.name_offset);
+        for (int k=0;k<2 && ok;k++)
+            for (int m=0;m<2;m++)
+                if (e.frag[k][m]<0 || e.frag[k][m]>=(e.len>0?e.len:1))
+                    ok=false;
+        if (!ok)
+        {
+            sprintf(message, "Corrupt entry %lld of TMdb database: %s\n",
+                c, filename);
+            PrintErrorAndQuit(message);
+        }
+
+        const char *record=base+entry[c].offset;
+        chain.len=entry[c].len;
+        chain.xyz=(const double *)record;
+        chain.resno=(const int *)(record+sizeof(double)*3*chain.len);
+        chain.seq=(const char *)(chain.resno+chain.len);
+        chain.sec=chain.seq+chain.len;
+        memcpy(chain.frag, entry[c].frag, sizeof(chain.frag));
+
+        chain_idx.push_back(store.chain.size());
+        name_list.push_back(names+entry[c].name_offset);
+        store.chain.push_back(chain);
+    }
+}
+
+void free_store(structure_store &store)
+{
+    for (size_t d=0;d<store.db_map.size();d++)
+        munmap(store.db_map[d].first, store.db_map[d].second);
+    store.db_map.clear();
+    store.chain.clear();
+    store.data.clear();
+    store.index.clear();
+}
+
+/* write the chains of name_list into database filename. Name i is saved as
+ * db_name[i]. Return the number of chains written; chains that cannot be
+ * read are skipped with a warning */
+int write_db(const char *filename, const vector<string> &name_list,
+    const vector<string> &db_name, const int ter_opt=3,
+    const string atom_opt=" CA ")
+{
+    ofstream fout(filename, ios::binary);
+    if (!fout.is_open())
+    {
+        char message[5000];
+        sprintf(message, "Can not open file: %s\n", filename);
+        PrintErrorAndQuit(message);
+    }
+
+    /* the entry table is written last, once all offsets are known */
+    tmdb_header header;
+    memcpy(header.magic, tmdb_magic, 8);
+    header.n_chain=0;
+    vector<tmdb_entry> entry(name_list.size());
+    long long offset=sizeof(tmdb_header)+sizeof(tmdb_entry)*entry.size();
+    fout.seekp(offset);
+
+    string names;
+    const char zero[8]={0,0,0,0,0,0,0,0};
+    for (size_t i=0;i<name_list.size();i++)
+    {
+        pdb_chain chain;
+        pdb_chain_data data;
+        if (!parse_pdb_chain(name_list[i].c_str(), chain, data,
+            ter_opt, atom_opt))
+        {
+            cerr<<"Warning! Can not open file: "<<name_list[i]<<endl;
+            continue;
+        }
+
+        tmdb_entry &e=entry[header.n_chain++];
+        e.offset=offset;
+        e.name_offset=names.size();
+        e.len=chain.len;
+        memcpy(e.frag, chain.frag, sizeof(e.frag));
+        e.pad=0;
+        names+=db_name[i];
+        names+='\0';
+
+        fout.write((const char *)chain.xyz, sizeof(double)*3*chain.len);
+        fout.write((const char *)chain.resno, sizeof(int)*chain.len);
+        fout.write(chain.seq, chain.len);
+        fout.write(chain.sec, chain.len);
+        offset+=(sizeof(double)*3+sizeof(int)+2)*chain.len;
+        if (offset%8)
+        {
+            fout.write(zero, 8-offset%8);
+            offset+=8-offset%8;
+        }
+    }
+    header.name_start=offset;
+    fout.write(names.data(), names.size());
+
+    fout.seekp(0);
+    fout.write((const char *)&header, sizeof(tmdb_header));
+    fout.write((const char *)&entry[0], sizeof(tmdb_entry)*header.n_chain);
+    fout.close();
+    return header.n_chain;
+}
+
+#endif
@@ -0,0 +1,98 @@
+"""Python interface of libtmalign.
+
+Aligns batches of structures held in NumPy arrays in one call of the C
+function tmalign_align_batch, which runs the pairs on its own threads.
+ctypes releases the GIL for the duration of the call. Coordinate arrays
+that are already C-contiguous float64 are passed without copying.
+
+    $ make libtmalign.so
+    >>> import numpy as np, tmalign
+    >>> res = tmalign.align_batch([xyz1, xyz2, xyz3], [(0, 1), (0, 2)])
+    >>> res["tm1"], res["u"], res["y2x"][0]
+
+The library is looked for next to this file, or at $TMALIGN_LIB.
+"""
+import ctypes
+import os
+
+import numpy as np
+
+_lib = ctypes.CDLL(os.environ.get("TMALIGN_LIB", os.path.join(
+    os.path.dirname(os.path.abspath(__file__)), "libtmalign.so")))
+
+
+class _Options(ctypes.Structure):
+    """tmalign_options of libtmalign.h"""
+    _fields_ = [("fast", ctypes.c_int),
+                ("a_opt", ctypes.c_int),
+                ("Lnorm_ass", ctypes.c_double),
+                ("d0_scale", ctypes.c_double)]
+
+
+_lib.tmalign_align_batch.restype = ctypes.c_int
+_lib.tmalign_align_batch.argtypes = [
+    ctypes.c_int, ctypes.POINTER(ctypes.c_void_p),
+    ctypes.POINTER(ctypes.c_char_p), ctypes.c_void_p, ctypes.c_longlong,
+    ctypes.c_void_p, ctypes.POINTER(_Options), ctypes.c_int,
+    ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+
+
+def align_batch(coords, pairs, seqs=None, threads=0, fast=False):
+    """Align chain pairs[k][0] onto chain pairs[k][1] for every k.
+
+    coords  -- sequence of (L, 3) arrays of CA coordinates, one per chain
+    pairs   -- (n, 2) array-like of indices into coords
+    seqs    -- optional sequence of one letter sequences, one per chain
+    threads -- number of threads, 0 for one per core
+    fast    -- as TMalign -fast
+
+    Returns a dict of arrays over the n pairs:
+      "stat"   0, or 1/2 if chain 1/2 has 5 or fewer residues
+      "tm1", "tm2"  TM-score normalized by length of chain 1 and chain 2
+      "rmsd", "lali", "seq_id"
+      "t" (n, 3) and "u" (n, 3, 3), superposing chain 1 onto chain 2 as
+          u @ x + t
+      "y2x"    list of n int arrays; y2x[k][j] is the residue of chain 1
+               aligned to residue j of chain 2, or -1
+    """
+    # keep the converted arrays referenced for the duration of the call
+    xyz = [np.ascontiguousarray(c, dtype=np.float64) for c in coords]
+    for c in xyz:
+        if c.ndim != 2 or c.shape[1] != 3:
+            raise ValueError("coordinates must have shape (L, 3)")
+    n_chain = len(xyz)
+    pair = np.ascontiguousarray(pairs, dtype=np.intc).reshape(-1, 2)
+    n_pair = len(pair)
+    if n_pair and (pair.min() < 0 or pair.max() >= n_chain):
+        raise IndexError("chain index of pairs out of range")
+
+    length = np.array([len(c) for c in xyz], dtype=np.intc)
+    xyz_ptr = (ctypes.c_void_p * n_chain)(*[c.ctypes.data for c in xyz])
+    seq_ptr = None
+    if seqs is not None:
+        seq_buf = [s.encode() if isinstance(s, str) else bytes(s)
+                   for s in seqs]
+        for s, n in zip(seq_buf, length):
+            if len(s) != n:
+                raise ValueError("sequence and coordinates differ in length")
+        seq_ptr = (ctypes.c_char_p * n_chain)(*seq_buf)
+
+    opt = _Options(int(fast), 0, 0.0, 0.0)
+    stat = np.empty(n_pair, dtype=np.intc)
+    score = np.empty((n_pair, 5), dtype=np.float64)
+    tu = np.empty((n_pair, 12), dtype=np.float64)
+    y2x_len = length[pair[:, 1]] if n_pair else np.zeros(0, dtype=np.intc)
+    y2x = np.empty(int(y2x_len.sum()), dtype=np.intc)
+
+    ret = _lib.tmalign_align_batch(
+        n_chain, xyz_ptr, seq_ptr, length.ctypes.data, n_pair,
+        pair.ctypes.data, ctypes.byref(opt), threads, stat.ctypes.data,
+        score.ctypes.data, tu.ctypes.data, y2x.ctypes.data)
+    if ret:
+        raise IndexError("chain index of pairs out of range")
+
+    return {"stat": stat,
+            "tm1": score[:, 0], "tm2": score[:, 1], "rmsd": score[:, 2],
+            "lali": score[:, 3].astype(np.intc), "seq_id": score[:, 4],
+            "t": tu[:, :3], "u": tu[:, 3:].reshape(-1, 3, 3),
+            "y2x": np.split(y2x, np.cumsum(y2x_len)[:-1]) if n_pair else []}
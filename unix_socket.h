@@ -0,0 +1,107 @@
+/*
+===============================================================================
+   Unix domain socket helpers shared by the TMalign -server mode and the
+   TMclient load generator.
+
+   Protocol: a client connects, sends the name of its query structure on the
+   first line followed by the text of the query PDB file, and shuts down its
+   sending side. The server answers with one outfmt 2 line per structure of
+   the database and closes the connection. A query that cannot be read is
+   answered with a single line starting with "ERROR".
+===============================================================================
+*/
+#ifndef UNIX_SOCKET_H
+#define UNIX_SOCKET_H
+
+#include <string>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+
+/* fill addr with socket path, return false if path is too long */
+bool set_socket_addr(sockaddr_un &addr, const char *path)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    if (strlen(path)>=sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+/* create a socket listening at path, return -1 on failure. A socket left
+ * at path by a previous server is replaced, but any other file is kept and
+ * fails with errno EEXIST */
+int listen_socket(const char *path)
+{
+    sockaddr_un addr;
+    if (!set_socket_addr(addr, path)) return -1;
+    struct stat st;
+    if (lstat(path, &st)==0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            errno=EEXIST;
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd<0) return -1;
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr))<0 || listen(fd, 128)<0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* connect to the socket at path, return -1 on failure */
+int connect_socket(const char *path)
+{
+    sockaddr_un addr;
+    if (!set_socket_addr(addr, path)) return -1;
+    int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd<0) return -1;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr))<0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* send all of buf, return false if the peer is gone */
+bool send_all(const int fd, const string &buf)
+{
+    size_t n_sent=0;
+    while (n_sent<buf.size())
+    {
+        ssize_t n=send(fd, buf.data()+n_sent, buf.size()-n_sent, MSG_NOSIGNAL);
+        if (n<0 && errno==EINTR) continue;
+        if (n<=0) return false;
+        n_sent+=n;
+    }
+    return true;
+}
+
+/* receive until the peer shuts down its sending side */
+bool recv_all(const int fd, string &buf)
+{
+    char chunk[65536];
+    buf.clear();
+    while (true)
+    {
+        ssize_t n=recv(fd, chunk, sizeof(chunk), 0);
+        if (n<0 && errno==EINTR) continue; // interrupted by a signal
+        if (n<0) return false;
+        if (n==0) return true;
+        buf.append(chunk, n);
+    }
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*
+===============================================================================
+   Work-stealing scheduler for running independent alignments, e.g. the
+   chain1 x chain2 pairs of -dir1/-dir2, on several threads.
+
+   Each worker owns a queue seeded with a contiguous block of jobs. It takes
+   jobs from the front of its own queue and, once that is empty, steals from
+   the back of the other queues. Neighbouring jobs, which usually share
+   chain1, therefore tend to run on the same thread.
+===============================================================================
+*/
+#ifndef WORK_STEAL_H
+#define WORK_STEAL_H
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+struct steal_queue
+{
+    mutex lock;
+    deque<int> jobs;
+};
+
+/* take one job from the front (owner) or the back (thief) of q */
+bool pop_job(steal_queue &q, int &job, const bool from_back)
+{
+    lock_guard<mutex> guard(q.lock);
+    if (q.jobs.empty()) return false;
+    if (from_back)
+    {
+        job=q.jobs.back();
+        q.jobs.pop_back();
+    }
+    else
+    {
+        job=q.jobs.front();
+        q.jobs.pop_front();
+    }
+    return true;
+}
+
+void steal_worker(vector<steal_queue> &queue, const int w,
+    const function<void(int, int)> &job)
+{
+    int n_thread=queue.size();
+    int k;
+    while (true)
+    {
+        if (pop_job(queue[w], k, false))
+        {
+            job(k, w);
+            continue;
+        }
+
+        /* own queue is empty, steal from the others */
+        bool stolen=false;
+        for (int v=1; v<n_thread && !stolen; v++)
+            stolen=pop_job(queue[(w+v)%n_thread], k, true);
+        if (!stolen) break; // no job is ever added, so all work is taken
+        job(k, w);
+    }
+}
+
+/* run job(k, worker) for k in [0, n_job) on n_thread threads, where
+ * worker in [0, n_thread) identifies the calling thread */
+void run_work_stealing(const int n_job, int n_thread,
+    const function<void(int, int)> &job)
+{
+    if (n_thread>n_job) n_thread=n_job;
+    if (n_thread<=1)
+    {
+        for (int k=0;k<n_job;k++) job(k, 0);
+        return;
+    }
+
+    vector<steal_queue> queue(n_thread);
+    for (int w=0;w<n_thread;w++)
+    {
+        int k_end=(long long)n_job*(w+1)/n_thread;
+        for (int k=(long long)n_job*w/n_thread;k<k_end;k++)
+            queue[w].jobs.push_back(k);
+    }
+
+    vector<thread> pool;
+    for (int w=0;w<n_thread;w++)
+        pool.push_back(thread(steal_worker, ref(queue), w, cref(job)));
+    for (int w=0;w<n_thread;w++) pool[w].join();
+}
+
+#endif